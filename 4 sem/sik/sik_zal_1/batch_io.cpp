@@ -0,0 +1,164 @@
+#include "batch_io.h"
+#include "message.h"
+#include "err.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+// The SyncStartTemplate keeps serialize() as the single source of the wire
+// format: the template is produced by it, and only the timestamp, located
+// right before the trailing synchronized byte, is rewritten afterwards.
+SyncStartTemplate::SyncStartTemplate(int synchronized_level, Precision msg_precision)
+    : synchronized(synchronized_level), precision(msg_precision) {
+    Message msg = make_SYNC_START(synchronized_level,
+                                  SyncClock::now(),
+                                  std::chrono::nanoseconds::zero(),
+                                  msg_precision);
+    bytes = serialize(msg);
+    timestamp_pos = bytes.size() - 1 - 8;
+}
+
+int SyncStartTemplate::level() const {
+    return synchronized;
+}
+
+void SyncStartTemplate::stamp(SyncClock::time_point start_time,
+                              std::chrono::nanoseconds offset,
+                              uint64_t accuracy_ns,
+                              SyncClock::time_point at) {
+    if (precision == Precision::NANOSECONDS) {
+        // The precision record's address bytes follow the type, count and
+        // address length bytes.
+        encode_timestamp(bytes.data() + 4, accuracy_ns);
+    }
+    encode_timestamp(bytes.data() + timestamp_pos,
+                     to_wire(clock_reading(synchronized, start_time, offset, at), precision));
+}
+
+const uint8_t *SyncStartTemplate::data() const {
+    return bytes.data();
+}
+
+size_t SyncStartTemplate::size() const {
+    return bytes.size();
+}
+
+size_t send_to_all(int socket_fd, int family,
+                   const std::vector<Endpoint> &destinations,
+                   const uint8_t *data, size_t len,
+                   const std::function<void()> &before_batch) {
+    // Every message points at the same payload; only the address differs.
+    iovec iov{};
+    iov.iov_base = const_cast<uint8_t *>(data);
+    iov.iov_len = len;
+    mmsghdr headers[IO_BATCH];
+    sockaddr_storage names[IO_BATCH];
+
+    size_t sent = 0;
+    size_t pos = 0;
+    while (pos < destinations.size()) {
+        // Gather the next chunk of reachable destinations.
+        size_t chunk = 0;
+        size_t end = pos;
+        while (chunk < IO_BATCH && end < destinations.size()) {
+            socklen_t name_len = destinations[end++].to_sockaddr(family, names[chunk]);
+            if (name_len == 0) continue;
+            std::memset(&headers[chunk], 0, sizeof(headers[chunk]));
+            headers[chunk].msg_hdr.msg_name = &names[chunk];
+            headers[chunk].msg_hdr.msg_namelen = name_len;
+            headers[chunk].msg_hdr.msg_iov = &iov;
+            headers[chunk].msg_hdr.msg_iovlen = 1;
+            ++chunk;
+        }
+        if (chunk == 0) break;
+        if (before_batch) before_batch();
+        // A partial send is resumed where the kernel stopped.
+        size_t first = 0;
+        while (first < chunk) {
+            int n = sendmmsg(socket_fd, headers + first, static_cast<unsigned int>(chunk - first), 0);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                // The first datagram of the chunk failed; skip it and go on.
+                error("sendmmsg failed");
+                first += 1;
+                continue;
+            }
+            sent += static_cast<size_t>(n);
+            first += static_cast<size_t>(n);
+        }
+        pos = end;
+    }
+    return sent;
+}
+
+bool enable_receive_timestamps(int socket_fd) {
+    int on = 1;
+    return setsockopt(socket_fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) == 0;
+}
+
+ReceiveBatch::ReceiveBatch(size_t size)
+    : datagram_size(size),
+      storage(IO_BATCH * size),
+      names(IO_BATCH),
+      senders(IO_BATCH),
+      controls(IO_BATCH),
+      arrivals(IO_BATCH),
+      iovecs(IO_BATCH),
+      headers(IO_BATCH) {}
+
+int ReceiveBatch::receive(int socket_fd) {
+    // recvmmsg overwrites msg_namelen and msg_len, so reset every header.
+    for (size_t i = 0; i < IO_BATCH; ++i) {
+        iovecs[i].iov_base = storage.data() + i * datagram_size;
+        iovecs[i].iov_len = datagram_size;
+        std::memset(&headers[i], 0, sizeof(headers[i]));
+        headers[i].msg_hdr.msg_name = &names[i];
+        headers[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+        headers[i].msg_hdr.msg_iov = &iovecs[i];
+        headers[i].msg_hdr.msg_iovlen = 1;
+        headers[i].msg_hdr.msg_control = &controls[i];
+        headers[i].msg_hdr.msg_controllen = sizeof(Control);
+    }
+    int n = recvmmsg(socket_fd, headers.data(), static_cast<unsigned int>(IO_BATCH),
+                     MSG_DONTWAIT, nullptr);
+    // Read both clocks right away: kernel timestamps are on CLOCK_REALTIME,
+    // so each one is carried over to the SyncClock by its age.
+    SyncClock::time_point raw_now = SyncClock::now();
+    timespec real_now;
+    clock_gettime(CLOCK_REALTIME, &real_now);
+    if (n < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return 0;
+        return -1;
+    }
+    for (size_t i = 0; i < static_cast<size_t>(n); ++i) {
+        // Any family other than AF_INET/AF_INET6 leaves the unspecified
+        // address, which matches no peer.
+        senders[i] = Endpoint::from_sockaddr(names[i]).value_or(Endpoint());
+        arrivals[i] = raw_now;
+        msghdr &hdr = headers[i].msg_hdr;
+        for (cmsghdr *c = CMSG_FIRSTHDR(&hdr); c != nullptr; c = CMSG_NXTHDR(&hdr, c)) {
+            if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_TIMESTAMPNS) continue;
+            timespec kernel;
+            std::memcpy(&kernel, CMSG_DATA(c), sizeof(kernel));
+            auto age = to_duration(real_now) - to_duration(kernel);
+            if (age > std::chrono::nanoseconds::zero()) arrivals[i] = raw_now - age;
+        }
+    }
+    return n;
+}
+
+const uint8_t *ReceiveBatch::data(size_t i) const {
+    return storage.data() + i * datagram_size;
+}
+
+size_t ReceiveBatch::length(size_t i) const {
+    return headers[i].msg_len;
+}
+
+const Endpoint &ReceiveBatch::sender(size_t i) const {
+    return senders[i];
+}
+
+SyncClock::time_point ReceiveBatch::received_at(size_t i) const {
+    return arrivals[i];
+}
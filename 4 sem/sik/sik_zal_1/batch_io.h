@@ -0,0 +1,106 @@
+#ifndef BATCH_IO_H
+#define BATCH_IO_H
+
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <functional>
+#include <vector>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "message.h"
+#include "sync_clock.h"
+#include "endpoint.h"
+
+// Maximum number of datagrams handed to a single sendmmsg/recvmmsg call.
+constexpr size_t IO_BATCH = 64;
+
+// The SyncStartTemplate class holds one serialized SYNC_START message.
+// Between fan-outs only the timestamp changes, so the message is serialized
+// once per synchronization level and precision, and its timestamp bytes (and
+// the accuracy of a nanosecond message) are patched in place.
+class SyncStartTemplate {
+public:
+    // Serializes a SYNC_START carrying the given synchronization level.
+    explicit SyncStartTemplate(int synchronized,
+                               Precision precision = Precision::MILLISECONDS);
+
+    // Returns the synchronization level the template was built for.
+    int level() const;
+
+    // Overwrites the timestamp field with the node's clock reading at `at`
+    // and, for a nanosecond template, the accuracy field with accuracy_ns.
+    void stamp(SyncClock::time_point start_time,
+               std::chrono::nanoseconds offset,
+               uint64_t accuracy_ns = UNKNOWN_ACCURACY,
+               SyncClock::time_point at = SyncClock::now());
+
+    const uint8_t *data() const;
+    size_t size() const;
+
+private:
+    int synchronized;
+    Precision precision;
+    size_t timestamp_pos;           // Offset of the 8-byte timestamp field.
+    std::vector<uint8_t> bytes;
+};
+
+// Sends the same datagram to every destination using sendmmsg, IO_BATCH
+// destinations per system call. family is the socket's address family
+// (AF_INET, or AF_INET6 for a dual-stack socket); IPv6 destinations cannot
+// be reached from an AF_INET socket and are skipped. before_batch, if given, runs right before
+// each call and may rewrite the payload in place (e.g. restamp a template),
+// so timestamps stay fresh across a large fan-out. Returns the number of
+// datagrams accepted by the kernel; failures are reported through error()
+// and skipped.
+size_t send_to_all(int socket_fd, int family,
+                   const std::vector<Endpoint> &destinations,
+                   const uint8_t *data, size_t len,
+                   const std::function<void()> &before_batch = nullptr);
+
+// Asks the kernel to timestamp every datagram received on socket_fd
+// (SO_TIMESTAMPNS). Returns false if the option is not supported, in which
+// case ReceiveBatch falls back to reading the clock after recvmmsg returns.
+bool enable_receive_timestamps(int socket_fd);
+
+// The ReceiveBatch class owns IO_BATCH receive buffers and drains up to that
+// many datagrams with a single recvmmsg call. The buffers are allocated once
+// and reused for the lifetime of the object. Along with each datagram it
+// records when it was received, on the SyncClock.
+class ReceiveBatch {
+public:
+    // Each buffer holds datagram_size bytes.
+    explicit ReceiveBatch(size_t datagram_size);
+
+    // Reads whatever is queued on a non-blocking socket, up to IO_BATCH
+    // datagrams. Returns the number received, 0 when nothing was pending,
+    // or -1 on an error other than EAGAIN.
+    int receive(int socket_fd);
+
+    const uint8_t *data(size_t i) const;
+    size_t length(size_t i) const;
+    const Endpoint &sender(size_t i) const;
+
+    // Returns when the i-th datagram arrived: the kernel receive timestamp if
+    // the socket has them enabled, otherwise the time recvmmsg returned.
+    SyncClock::time_point received_at(size_t i) const;
+
+private:
+    // Room for one SCM_TIMESTAMPNS control message, suitably aligned.
+    union Control {
+        cmsghdr header;
+        uint8_t bytes[CMSG_SPACE(sizeof(timespec))];
+    };
+
+    size_t datagram_size;
+    std::vector<uint8_t> storage;           // IO_BATCH buffers back to back.
+    std::vector<sockaddr_storage> names;    // Filled in by recvmmsg.
+    std::vector<Endpoint> senders;
+    std::vector<Control> controls;
+    std::vector<SyncClock::time_point> arrivals;
+    std::vector<iovec> iovecs;
+    std::vector<mmsghdr> headers;
+};
+
+#endif // BATCH_IO_H
@@ -0,0 +1,161 @@
+// Benchmark of per-datagram versus batched UDP I/O over loopback.
+//
+// Usage: ./bench-batch-io [peers] [rounds]
+//   SYNC_START fan-out: make_SYNC_START + serialize + sendto per peer, against
+//   one SyncStartTemplate sent with sendmmsg.  Reception: one recvfrom per
+//   datagram, against ReceiveBatch draining IO_BATCH datagrams per recvmmsg.
+// Rates are messages per second of CPU time of this thread, i.e. per core.
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "err.h"
+#include "message.h"
+#include "batch_io.h"
+
+using namespace std;
+using namespace chrono;
+
+// Number of distinct receiving sockets the peer list cycles over.
+constexpr size_t SINKS = 16;
+
+// Returns the CPU time consumed by the calling thread, in seconds.
+static double thread_cpu_seconds() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) * 1e-9;
+}
+
+// Opens a UDP socket bound to an ephemeral loopback port and returns its address.
+static int open_loopback(sockaddr_in &addr, int rcvbuf = 0) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) syserr("socket");
+    if (rcvbuf > 0) {
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    }
+    addr = sockaddr_in{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) syserr("bind");
+    socklen_t len = sizeof(addr);
+    if (getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len) < 0) syserr("getsockname");
+    return fd;
+}
+
+// Runs fn and prints how many messages per CPU-second it achieved.
+static double report(const string &name, size_t messages, const function<void()> &fn) {
+    double start = thread_cpu_seconds();
+    fn();
+    double cpu = thread_cpu_seconds() - start;
+    double rate = static_cast<double>(messages) / cpu;
+    cout << left << setw(34) << name << right << setw(12) << messages << " msgs"
+         << setw(12) << fixed << setprecision(0) << rate << " msgs/s/core\n";
+    return rate;
+}
+
+int main(int argc, char *argv[]) {
+    size_t peers  = argc > 1 ? strtoul(argv[1], nullptr, 10) : 4096;
+    size_t rounds = argc > 2 ? strtoul(argv[2], nullptr, 10) : 50;
+    if (peers == 0 || rounds == 0) fatal("usage: bench-batch-io [peers] [rounds]");
+
+    // Receivers: a handful of sockets stand in for thousands of peers.  They
+    // are never read in the fan-out test; excess datagrams are simply dropped.
+    vector<int> sinks;
+    vector<sockaddr_in> sink_addrs(SINKS);
+    for (size_t i = 0; i < SINKS; ++i) sinks.push_back(open_loopback(sink_addrs[i]));
+    vector<Endpoint> destinations;
+    for (size_t i = 0; i < peers; ++i) destinations.emplace_back(sink_addrs[i % SINKS]);
+
+    sockaddr_in self;
+    int tx = open_loopback(self);
+    auto start_time = SyncClock::now();
+    auto offset = milliseconds(3);
+
+    cout << "SYNC_START fan-out to " << peers << " peers, " << rounds << " rounds\n";
+    double per_peer = report("sendto per peer", peers * rounds, [&] {
+        for (size_t r = 0; r < rounds; ++r) {
+            for (const Endpoint &peer : destinations) {
+                auto buf = serialize(make_SYNC_START(1, start_time, offset));
+                sockaddr_storage dest;
+                socklen_t dest_len = peer.to_sockaddr(AF_INET, dest);
+                sendto(tx, buf.data(), buf.size(), 0,
+                       reinterpret_cast<const sockaddr*>(&dest), dest_len);
+            }
+        }
+    });
+    double batched = report("template + sendmmsg", peers * rounds, [&] {
+        SyncStartTemplate tmpl(1);
+        for (size_t r = 0; r < rounds; ++r) {
+            send_to_all(tx, AF_INET, destinations, tmpl.data(), tmpl.size(),
+                        [&] { tmpl.stamp(start_time, offset); });
+        }
+    });
+    cout << "speedup " << setprecision(2) << batched / per_peer << "x\n\n";
+
+    // Reception: fill the socket with one batch (untimed), then drain it.
+    sockaddr_in rx_addr;
+    int rx = open_loopback(rx_addr, 1 << 22);
+    vector<Endpoint> to_rx(IO_BATCH, Endpoint(rx_addr));
+    SyncStartTemplate tmpl(1);
+    size_t batches = peers * rounds / IO_BATCH;
+    vector<uint8_t> buf(65536);
+    ReceiveBatch batch(65536);
+
+    auto timed_drain = [&](const function<size_t()> &drain) {
+        double cpu = 0;
+        size_t got = 0;
+        for (size_t b = 0; b < batches; ++b) {
+            send_to_all(tx, AF_INET, to_rx, tmpl.data(), tmpl.size());
+            double start = thread_cpu_seconds();
+            got += drain();
+            cpu += thread_cpu_seconds() - start;
+        }
+        return make_pair(got, cpu);
+    };
+
+    cout << "Reception of " << batches * IO_BATCH << " datagrams\n";
+    auto [got_single, cpu_single] = timed_drain([&] {
+        size_t got = 0;
+        for (size_t i = 0; i < IO_BATCH; ++i) {
+            sockaddr_in from{};
+            socklen_t len = sizeof(from);
+            ssize_t n = recvfrom(rx, buf.data(), buf.size(), MSG_DONTWAIT,
+                                 reinterpret_cast<sockaddr*>(&from), &len);
+            if (n < 0) break;
+            Message m = deserialize(buf.data(), static_cast<size_t>(n));
+            got += m.message == 11;
+        }
+        return got;
+    });
+    auto [got_batch, cpu_batch] = timed_drain([&] {
+        size_t got = 0;
+        int n = batch.receive(rx);
+        for (int i = 0; i < n; ++i) {
+            Message m = deserialize(batch.data(static_cast<size_t>(i)), batch.length(static_cast<size_t>(i)));
+            got += m.message == 11;
+        }
+        return got;
+    });
+    double rate_single = static_cast<double>(got_single) / cpu_single;
+    double rate_batch = static_cast<double>(got_batch) / cpu_batch;
+    cout << left << setw(34) << "recvfrom per datagram" << right << setw(12) << got_single << " msgs"
+         << setw(12) << setprecision(0) << rate_single << " msgs/s/core\n";
+    cout << left << setw(34) << "recvmmsg batch" << right << setw(12) << got_batch << " msgs"
+         << setw(12) << setprecision(0) << rate_batch << " msgs/s/core\n";
+    cout << "speedup " << setprecision(2) << rate_batch / rate_single << "x\n";
+
+    for (int fd : sinks) close(fd);
+    close(tx);
+    close(rx);
+    return 0;
+}
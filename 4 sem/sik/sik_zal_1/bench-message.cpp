@@ -0,0 +1,97 @@
+// Benchmark of Message encoding and decoding.
+//
+// Usage: ./bench-message [nodes] [iterations]
+//   Builds a HELLO_REPLY listing `nodes` contacts (4000 by default) and times
+//   the allocating path (make_HELLO_REPLY + serialize, deserialize) against
+//   the caller-buffer path (encode_HELLO_REPLY, MessageView with lazy node
+//   iteration). Heap allocations are counted by replacing operator new.
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <chrono>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+#include <arpa/inet.h>
+
+#include "err.h"
+#include "message.h"
+
+using namespace std;
+using namespace chrono;
+
+static size_t allocations = 0;
+
+void *operator new(size_t size) {
+    ++allocations;
+    if (void *p = malloc(size ? size : 1)) return p;
+    throw bad_alloc();
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+// Sink keeps the optimizer from discarding decoded values.
+static volatile uint64_t sink = 0;
+
+// Runs fn iterations times and prints ns and allocations per iteration.
+static double run(const string &name, size_t iterations, const function<void()> &fn) {
+    fn();   // Warm-up: fault in buffers before counting.
+    size_t before = allocations;
+    auto start = steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) fn();
+    double ns = static_cast<double>(duration_cast<nanoseconds>(steady_clock::now() - start).count());
+    double per = ns / static_cast<double>(iterations);
+    cout << left << setw(36) << name << right << fixed << setprecision(1)
+         << setw(12) << per / 1000.0 << " us/op"
+         << setw(10) << setprecision(2)
+         << static_cast<double>(allocations - before) / static_cast<double>(iterations) << " allocs/op\n";
+    return per;
+}
+
+int main(int argc, char *argv[]) {
+    size_t nodes      = argc > 1 ? strtoul(argv[1], nullptr, 10) : 4000;
+    size_t iterations = argc > 2 ? strtoul(argv[2], nullptr, 10) : 2000;
+    if (iterations == 0) fatal("usage: bench-message [nodes] [iterations]");
+
+    vector<Endpoint> contacts;
+    for (size_t i = 0; i < nodes; ++i) {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(0x0A000000u + static_cast<uint32_t>(i));
+        addr.sin_port = htons(static_cast<uint16_t>(10000 + i % 50000));
+        contacts.emplace_back(addr);
+    }
+
+    vector<uint8_t> buf(MAX_UDP_PAYLOAD);
+    size_t len = encode_HELLO_REPLY(contacts, buf);
+    if (len == 0) fatal("HELLO_REPLY does not fit in a datagram");
+    cout << "HELLO_REPLY with " << nodes << " nodes, " << len << " bytes\n";
+
+    double old_enc = run("make_HELLO_REPLY + serialize", iterations, [&] {
+        auto bytes = serialize(make_HELLO_REPLY(contacts));
+        sink = sink + bytes.size();
+    });
+    double new_enc = run("encode_HELLO_REPLY into buffer", iterations, [&] {
+        sink = sink + encode_HELLO_REPLY(contacts, buf);
+    });
+
+    double old_dec = run("deserialize", iterations, [&] {
+        Message m = deserialize(buf.data(), len);
+        uint64_t sum = 0;
+        for (const NodeRecord &nr : m.nodes) sum += nr.peer_port;
+        sink = sink + sum;
+    });
+    double new_dec = run("MessageView + node iteration", iterations, [&] {
+        MessageView view;
+        if (!view.parse(buf.data(), len)) fatal("parse failed");
+        uint64_t sum = 0;
+        for (NodeView node : view) sum += node.peer_port;
+        sink = sink + sum;
+    });
+
+    cout << setprecision(1) << "encode speedup " << old_enc / new_enc
+         << "x, decode speedup " << old_dec / new_dec << "x\n";
+    return 0;
+}
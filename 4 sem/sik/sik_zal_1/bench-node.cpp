@@ -0,0 +1,394 @@
+// Load generator for a running peer-time-sync node.
+//
+// Usage: ./bench-node -a ADDRESS -r PORT [-m get_time|delay_request]
+//                     [-n SOCKETS] [-j THREADS] [-q RATE[,RATE...]]
+//                     [-d SECONDS] [-w TIMEOUT_MS] [-o FILE]
+//   Sends GET_TIME (the default) or DELAY_REQUEST to the node at a fixed
+//   total rate per step, spread over SOCKETS UDP sockets (256) and THREADS
+//   sending threads (1), for SECONDS (5) per step. Each socket has at most
+//   one request in flight, so every TIME or DELAY_RESPONSE is matched to its
+//   request and the latency is exact. A request unanswered after TIMEOUT_MS
+//   (1000) is lost, and its socket sits out the rest of the step, so a late
+//   reply cannot be matched to a newer request. A request due while every
+//   socket is busy is not sent and counts as stalled.
+//
+//   For DELAY_REQUEST every socket first joins with a HELLO, since nodes
+//   answer only their neighbours; run the node without -f, which only
+//   answers peers it offered SYNC_START to. Nodes also limit the requests
+//   they answer per sender: run them with -l 0 to measure the node rather
+//   than the limit. DELAY_REQUEST stays limited to a few a second per
+//   socket, so that mode needs many sockets.
+//
+//   With -q the listed rates are run in order. Without it the rate starts at
+//   1000 requests/s and doubles until a step is not sustained, then is
+//   bisected between the last sustained and the first failed rate. A step is
+//   sustained if at least 99% of the requests due were sent and at most 1% of
+//   them were lost. Each step prints the send and reply rates, loss and the
+//   latency percentiles, and with -o is appended to FILE as a CSV row.
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "err.h"
+#include "message.h"
+#include "endpoint.h"
+#include "sync_clock.h"
+
+using namespace std;
+using namespace chrono;
+
+struct BenchOptions {
+    optional<Endpoint> target;
+    bool delay_request = false;
+    size_t sockets = 256;
+    size_t threads = 1;
+    vector<double> rates;
+    nanoseconds step = seconds(5);
+    nanoseconds timeout = seconds(1);
+    string csv;
+};
+
+// The outcome of one step, from one thread or merged over all of them.
+struct StepResult {
+    uint64_t due = 0, sent = 0, received = 0, lost = 0, stalled = 0;
+    vector<uint32_t> latencies;     // Nanoseconds, one per reply.
+
+    void merge(StepResult &&other) {
+        due += other.due;
+        sent += other.sent;
+        received += other.received;
+        lost += other.lost;
+        stalled += other.stalled;
+        latencies.insert(latencies.end(), other.latencies.begin(), other.latencies.end());
+    }
+};
+
+// The Worker class drives one thread's share of the sockets and the rate.
+class Worker {
+public:
+    Worker(const Endpoint &target, size_t count, bool delay_request)
+        : reply_type(delay_request ? 13 : 32),
+          request(serialize(delay_request ? make_DELAY_REQUEST()
+                                          : make_GET_TIME(CAPABILITY_NANOSECONDS))),
+          buf(65536) {
+        epoll_fd = epoll_create1(0);
+        if (epoll_fd < 0) syserr("epoll_create1");
+        sockaddr_storage addr;
+        int family = target.is_v4() ? AF_INET : AF_INET6;
+        socklen_t addr_len = target.to_sockaddr(family, addr);
+        for (size_t k = 0; k < count; ++k) {
+            int fd = socket(family, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+            if (fd < 0) syserr("socket");
+            if (connect(fd, reinterpret_cast<sockaddr *>(&addr), addr_len) < 0) syserr("connect");
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.u32 = static_cast<uint32_t>(k);
+            if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) syserr("epoll_ctl");
+            fds.push_back(fd);
+        }
+        if (delay_request) join();
+    }
+
+    Worker(const Worker &) = delete;
+    Worker &operator=(const Worker &) = delete;
+
+    ~Worker() {
+        for (int fd : fds) close(fd);
+        close(epoll_fd);
+    }
+
+    size_t sockets() const { return fds.size(); }
+
+    StepResult run(double rate, nanoseconds length, nanoseconds timeout) {
+        StepResult r;
+        const auto idle_mark = SyncClock::time_point::min();
+        const auto retired = SyncClock::time_point::max();
+        vector<SyncClock::time_point> sent_at(fds.size(), idle_mark);
+        vector<uint32_t> idle;
+        for (size_t k = 0; k < fds.size(); ++k) {
+            drain(k);
+            idle.push_back(static_cast<uint32_t>(k));
+        }
+        size_t outstanding = 0;
+        epoll_event events[64];
+
+        auto start = SyncClock::now();
+        auto end = start + length;
+        auto next_sweep = start + milliseconds(1);
+        while (true) {
+            auto now = SyncClock::now();
+            if (now < end) {
+                auto due = static_cast<uint64_t>(duration<double>(now - start).count() * rate);
+                for (; r.due < due; ++r.due) {
+                    if (idle.empty()) {
+                        ++r.stalled;
+                        continue;
+                    }
+                    uint32_t k = idle.back();
+                    if (send(fds[k], request.data(), request.size(), 0) < 0) {
+                        ++r.stalled;
+                        continue;
+                    }
+                    idle.pop_back();
+                    sent_at[k] = now;
+                    ++outstanding;
+                    ++r.sent;
+                }
+            } else if (outstanding == 0 || now >= end + timeout) {
+                break;
+            }
+
+            // Sleep in epoll only while the next request is a millisecond away.
+            int wait_ms = 0;
+            if (now >= end) {
+                wait_ms = 1;
+            } else if (rate < 1000) {
+                auto next = start + duration_cast<nanoseconds>(
+                    duration<double>(static_cast<double>(r.due + 1) / rate));
+                wait_ms = static_cast<int>(max<int64_t>(duration_cast<milliseconds>(next - now).count(), 0));
+            }
+            int n = epoll_wait(epoll_fd, events, 64, wait_ms);
+            if (n < 0 && errno != EINTR) syserr("epoll_wait");
+            for (int e = 0; e < n; ++e) {
+                uint32_t k = events[e].data.u32;
+                ssize_t len;
+                while ((len = recv(fds[k], buf.data(), buf.size(), 0)) > 0) {
+                    if (buf[0] != reply_type || sent_at[k] == idle_mark || sent_at[k] == retired) continue;
+                    auto latency = SyncClock::now() - sent_at[k];
+                    r.latencies.push_back(static_cast<uint32_t>(min<int64_t>(latency.count(), UINT32_MAX)));
+                    ++r.received;
+                    sent_at[k] = idle_mark;
+                    --outstanding;
+                    idle.push_back(k);
+                }
+            }
+
+            // A socket whose request timed out stays busy until the step ends.
+            if (now >= next_sweep) {
+                next_sweep = now + milliseconds(1);
+                for (size_t k = 0; k < fds.size(); ++k) {
+                    if (sent_at[k] != idle_mark && sent_at[k] != retired && now - sent_at[k] > timeout) {
+                        sent_at[k] = retired;
+                        --outstanding;
+                        ++r.lost;
+                    }
+                }
+            }
+        }
+        for (auto t : sent_at) {
+            if (t != idle_mark && t != retired) ++r.lost;
+        }
+        return r;
+    }
+
+private:
+    // Introduces every socket to the node with a HELLO that does not
+    // advertise gossip, so the node admits them all as neighbours. Sockets
+    // that get no HELLO_REPLY within a second are dropped.
+    void join() {
+        Message hello = make_HELLO();
+        hello.timestamp = CAPABILITY_NANOSECONDS;
+        vector<uint8_t> bytes = serialize(hello);
+        for (int fd : fds) {
+            if (send(fd, bytes.data(), bytes.size(), 0) < 0) syserr("send HELLO");
+        }
+        vector<bool> joined(fds.size(), false);
+        size_t count = 0;
+        epoll_event events[64];
+        auto deadline = SyncClock::now() + seconds(1);
+        while (count < fds.size() && SyncClock::now() < deadline) {
+            int n = epoll_wait(epoll_fd, events, 64, 10);
+            for (int e = 0; e < n; ++e) {
+                uint32_t k = events[e].data.u32;
+                while (recv(fds[k], buf.data(), buf.size(), 0) > 0) {
+                    if (buf[0] == 2 && !joined[k]) {
+                        joined[k] = true;
+                        ++count;
+                    }
+                }
+            }
+        }
+        vector<int> kept;
+        for (size_t k = 0; k < fds.size(); ++k) {
+            if (joined[k]) {
+                epoll_event ev{};
+                ev.events = EPOLLIN;
+                ev.data.u32 = static_cast<uint32_t>(kept.size());
+                epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fds[k], &ev);
+                kept.push_back(fds[k]);
+            } else {
+                close(fds[k]);
+            }
+        }
+        fds = std::move(kept);
+    }
+
+    // Discards whatever is queued on socket k: SYNC_STARTs and late replies.
+    void drain(size_t k) {
+        while (recv(fds[k], buf.data(), buf.size(), 0) > 0) {}
+    }
+
+    uint8_t reply_type;
+    vector<uint8_t> request;
+    vector<uint8_t> buf;
+    vector<int> fds;
+    int epoll_fd;
+};
+
+static double percentile(const vector<uint32_t> &sorted, double p) {
+    if (sorted.empty()) return 0;
+    auto i = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1));
+    return static_cast<double>(sorted[i]) / 1e3;
+}
+
+// Runs one step on every worker at rate in total, prints it and appends it to
+// the CSV file. Returns true if the step was sustained.
+static bool run_step(vector<unique_ptr<Worker>> &workers, double rate, const BenchOptions &opts, ofstream &csv) {
+    vector<StepResult> parts(workers.size());
+    vector<thread> threads;
+    for (size_t i = 0; i < workers.size(); ++i) {
+        threads.emplace_back([&, i] {
+            parts[i] = workers[i]->run(rate / static_cast<double>(workers.size()), opts.step, opts.timeout);
+        });
+    }
+    for (auto &t : threads) t.join();
+    StepResult r;
+    for (auto &p : parts) r.merge(std::move(p));
+    sort(r.latencies.begin(), r.latencies.end());
+
+    double secs = duration<double>(opts.step).count();
+    double loss = r.sent ? 100.0 * static_cast<double>(r.lost) / static_cast<double>(r.sent) : 0;
+    double p50 = percentile(r.latencies, 0.5), p90 = percentile(r.latencies, 0.9);
+    double p99 = percentile(r.latencies, 0.99), p999 = percentile(r.latencies, 0.999);
+    double max_us = r.latencies.empty() ? 0 : static_cast<double>(r.latencies.back()) / 1e3;
+    bool sustained = r.due > 0 &&
+                     static_cast<double>(r.sent) >= 0.99 * static_cast<double>(r.due) &&
+                     static_cast<double>(r.lost) <= 0.01 * static_cast<double>(r.sent);
+
+    cout << fixed << setprecision(0) << setw(10) << rate
+         << setw(11) << static_cast<double>(r.sent) / secs
+         << setw(11) << static_cast<double>(r.received) / secs
+         << setprecision(2) << setw(8) << loss
+         << setw(10) << r.stalled
+         << setprecision(1) << setw(9) << p50 << setw(9) << p90 << setw(9) << p99
+         << setw(9) << p999 << setw(10) << max_us
+         << (sustained ? "" : "  not sustained") << "\n";
+    if (csv.is_open()) {
+        csv << (opts.delay_request ? "delay_request" : "get_time") << ',' << setprecision(0) << rate
+            << ',' << opts.sockets << ',' << workers.size() << ',' << setprecision(3) << secs
+            << ',' << r.due << ',' << r.sent << ',' << r.received << ',' << r.lost << ',' << r.stalled
+            << ',' << setprecision(4) << loss << ',' << setprecision(1)
+            << static_cast<double>(r.sent) / secs << ',' << static_cast<double>(r.received) / secs
+            << ',' << setprecision(2) << p50 << ',' << p90 << ',' << p99 << ',' << p999 << ','
+            << max_us << ',' << (sustained ? 1 : 0) << '\n';
+        csv.flush();
+    }
+    return sustained;
+}
+
+static vector<double> read_rates(const string &list) {
+    vector<double> rates;
+    stringstream ss(list);
+    string item;
+    while (getline(ss, item, ',')) {
+        char *end = nullptr;
+        double rate = strtod(item.c_str(), &end);
+        if (*end != '\0' || rate <= 0) fatal("invalid rate");
+        rates.push_back(rate);
+    }
+    return rates;
+}
+
+int main(int argc, char *argv[]) {
+    BenchOptions opts;
+    string address;
+    unsigned long port = 0;
+    int ch;
+    while ((ch = getopt(argc, argv, "a:r:m:n:j:q:d:w:o:")) != -1) {
+        switch (ch) {
+            case 'a': address = optarg; break;
+            case 'r': port = strtoul(optarg, nullptr, 10); break;
+            case 'm':
+                if (string(optarg) == "delay_request") opts.delay_request = true;
+                else if (string(optarg) != "get_time") fatal("invalid mode");
+                break;
+            case 'n': opts.sockets = strtoul(optarg, nullptr, 10); break;
+            case 'j': opts.threads = strtoul(optarg, nullptr, 10); break;
+            case 'q': opts.rates = read_rates(optarg); break;
+            case 'd': opts.step = duration_cast<nanoseconds>(duration<double>(strtod(optarg, nullptr))); break;
+            case 'w': opts.timeout = milliseconds(strtoul(optarg, nullptr, 10)); break;
+            case 'o': opts.csv = optarg; break;
+            default: fatal("usage: bench-node -a ADDRESS -r PORT [-m get_time|delay_request] "
+                           "[-n SOCKETS] [-j THREADS] [-q RATE[,RATE...]] [-d SECONDS] "
+                           "[-w TIMEOUT_MS] [-o FILE]");
+        }
+    }
+    if (port == 0 || port > UINT16_MAX) fatal("a port is required (-r)");
+    opts.target = Endpoint::parse(address, static_cast<uint16_t>(port));
+    if (!opts.target) fatal("invalid address (-a)");
+    if (opts.threads == 0 || opts.sockets < opts.threads || opts.step <= nanoseconds(0) ||
+        opts.timeout <= nanoseconds(0)) {
+        fatal("invalid sockets, threads, step length or timeout");
+    }
+
+    vector<unique_ptr<Worker>> workers;
+    size_t joined = 0;
+    for (size_t i = 0; i < opts.threads; ++i) {
+        size_t share = opts.sockets / opts.threads + (i < opts.sockets % opts.threads ? 1 : 0);
+        workers.push_back(make_unique<Worker>(*opts.target, share, opts.delay_request));
+        joined += workers.back()->sockets();
+    }
+    if (joined == 0) fatal("the node answered no HELLO");
+    opts.sockets = joined;
+
+    ofstream csv;
+    if (!opts.csv.empty()) {
+        bool fresh = !ifstream(opts.csv).good();
+        csv.open(opts.csv, ios::app);
+        csv << fixed;
+        if (!csv) fatal("cannot open " + opts.csv);
+        if (fresh) {
+            csv << "mode,rate,sockets,threads,seconds,due,sent,received,lost,stalled,loss_pct,"
+                   "sent_per_s,received_per_s,p50_us,p90_us,p99_us,p999_us,max_us,sustained\n";
+        }
+    }
+
+    cout << (opts.delay_request ? "DELAY_REQUEST" : "GET_TIME") << " to " << opts.target->to_string()
+         << " from " << opts.sockets << " sockets, " << opts.threads << " threads\n"
+         << "      rate     sent/s  replies/s   loss%   stalled      p50      p90      p99"
+            "    p99.9    max us\n";
+    if (!opts.rates.empty()) {
+        for (double rate : opts.rates) run_step(workers, rate, opts, csv);
+        return 0;
+    }
+
+    double good = 0, bad = 0;
+    for (double rate = 1000; rate <= 1e8; rate *= 2) {
+        if (!run_step(workers, rate, opts, csv)) {
+            bad = rate;
+            break;
+        }
+        good = rate;
+    }
+    for (int i = 0; i < 4 && bad > 0 && good > 0; ++i) {
+        double rate = (good + bad) / 2;
+        if (run_step(workers, rate, opts, csv)) good = rate;
+        else bad = rate;
+    }
+    cout << "max sustained rate: " << setprecision(0) << good << " requests/s\n";
+    return 0;
+}
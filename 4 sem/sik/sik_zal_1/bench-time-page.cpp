@@ -0,0 +1,119 @@
+// Benchmark of time page reads against GET_TIME round trips.
+//
+// Usage: ./bench-time-page [reads] [port]
+//   Publishes a private time page and times `reads` (10M by default)
+//   TimePageReader::read calls, first with a quiet writer and then with a
+//   thread republishing the page continuously. The writer alternates between
+//   two parameter sets that give the same reading, so a torn read would be
+//   off by a second; the number of such reads is printed and must be 0.
+//   With `port`, also times GET_TIME / TIME round trips to the
+//   peer-time-sync listening on 127.0.0.1:port.
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cmath>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "err.h"
+#include "message.h"
+#include "time_page.h"
+#include "time_publisher.h"
+
+using namespace std;
+using namespace chrono;
+
+// Sink keeps the optimizer from discarding readings.
+static volatile int64_t sink = 0;
+
+// Runs fn n times and prints ns per call and calls per second.
+static void report(const string &name, size_t n, const function<void()> &fn) {
+    auto start = steady_clock::now();
+    for (size_t i = 0; i < n; ++i) fn();
+    double ns = static_cast<double>(duration_cast<nanoseconds>(steady_clock::now() - start).count());
+    double per = ns / static_cast<double>(n);
+    cout << left << setw(34) << name << right << fixed << setprecision(1)
+         << setw(10) << per << " ns/read" << setw(14) << setprecision(0) << 1e9 / per
+         << " reads/s\n";
+}
+
+int main(int argc, char *argv[]) {
+    size_t reads = argc > 1 ? strtoul(argv[1], nullptr, 10) : 10'000'000;
+    unsigned long port = argc > 2 ? strtoul(argv[2], nullptr, 10) : 0;
+    if (reads == 0 || port > UINT16_MAX) fatal("usage: bench-time-page [reads] [port]");
+
+    string name = "/bench-time-page-" + to_string(getpid());
+    TimePublisher publisher(name);
+    auto start = SyncClock::now() - seconds(100);
+    const nanoseconds offset = seconds(1);
+    const double drift = 20e-6;
+    publisher.publish(1, start, offset, start, drift, 1000);
+    auto reader = TimePageReader::open(name);
+    shm_unlink(name.c_str());
+    if (!reader) fatal("cannot open the time page");
+
+    TimeReading t;
+    report("SyncClock::now", reads, [&] {
+        sink = sink + SyncClock::now().time_since_epoch().count();
+    });
+    report("TimePageReader::read", reads, [&] {
+        reader->read(t);
+        sink = sink + t.time.count();
+    });
+
+    // Both parameter sets read as now - start - offset, less the drift
+    // since start.
+    atomic<bool> stop{false};
+    size_t updates = 0;
+    thread writer([&] {
+        for (bool flip = false; !stop.load(memory_order_relaxed); flip = !flip, ++updates) {
+            if (flip) publisher.publish(1, start + offset, nanoseconds(0), start, drift, 1000);
+            else publisher.publish(1, start, offset, start, drift, 1000);
+        }
+    });
+    size_t torn = 0, failed = 0;
+    report("read, writer republishing", reads, [&] {
+        if (!reader->read(t)) {
+            ++failed;
+            return;
+        }
+        auto since = SyncClock::now() - start;
+        auto expected = since - offset -
+                        nanoseconds(llround(drift * static_cast<double>(since.count())));
+        if (abs(expected - t.time) > milliseconds(100)) ++torn;
+    });
+    stop = true;
+    writer.join();
+    cout << "  " << updates << " updates, " << torn << " torn reads, "
+         << failed << " reads gave up\n";
+
+    if (port == 0) return 0;
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) syserr("socket");
+    timeval timeout{1, 0};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    sockaddr_in node{};
+    node.sin_family = AF_INET;
+    node.sin_port = htons(static_cast<uint16_t>(port));
+    node.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(sock, reinterpret_cast<sockaddr *>(&node), sizeof(node)) < 0) syserr("connect");
+    vector<uint8_t> request = serialize(make_GET_TIME(CAPABILITY_NANOSECONDS));
+    vector<uint8_t> buf(65536);
+    size_t trips = max<size_t>(reads / 1000, 1);
+    report("GET_TIME round trip", trips, [&] {
+        if (send(sock, request.data(), request.size(), 0) < 0) syserr("send");
+        ssize_t n = recv(sock, buf.data(), buf.size(), 0);
+        if (n < 0) fatal("no TIME from the node");
+        sink = sink + n;
+    });
+    close(sock);
+    return 0;
+}
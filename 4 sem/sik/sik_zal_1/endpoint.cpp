@@ -0,0 +1,108 @@
+#include "endpoint.h"
+#include <cstring>
+#include <arpa/inet.h>
+
+// The v4-mapped prefix ::ffff:0:0/96.
+static constexpr uint8_t V4_MAPPED[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+
+Endpoint::Endpoint(const sockaddr_in &addr) : port_be(addr.sin_port) {
+    std::memcpy(address.data(), V4_MAPPED, sizeof(V4_MAPPED));
+    std::memcpy(address.data() + 12, &addr.sin_addr, 4);
+}
+
+Endpoint::Endpoint(const sockaddr_in6 &addr) : port_be(addr.sin6_port) {
+    std::memcpy(address.data(), &addr.sin6_addr, 16);
+}
+
+std::optional<Endpoint> Endpoint::from_sockaddr(const sockaddr_storage &addr) {
+    if (addr.ss_family == AF_INET) {
+        return Endpoint(reinterpret_cast<const sockaddr_in &>(addr));
+    }
+    if (addr.ss_family == AF_INET6) {
+        return Endpoint(reinterpret_cast<const sockaddr_in6 &>(addr));
+    }
+    return std::nullopt;
+}
+
+std::optional<Endpoint> Endpoint::from_bytes(const uint8_t *bytes, size_t length,
+                                             uint16_t network_port) {
+    Endpoint e;
+    e.port_be = network_port;
+    if (length == 4) {
+        std::memcpy(e.address.data(), V4_MAPPED, sizeof(V4_MAPPED));
+        std::memcpy(e.address.data() + 12, bytes, 4);
+    } else if (length == 16) {
+        std::memcpy(e.address.data(), bytes, 16);
+    } else {
+        return std::nullopt;
+    }
+    return e;
+}
+
+std::optional<Endpoint> Endpoint::parse(const std::string &text, uint16_t port) {
+    Endpoint e;
+    e.port_be = htons(port);
+    in_addr v4;
+    if (inet_pton(AF_INET, text.c_str(), &v4) == 1) {
+        std::memcpy(e.address.data(), V4_MAPPED, sizeof(V4_MAPPED));
+        std::memcpy(e.address.data() + 12, &v4, 4);
+        return e;
+    }
+    if (inet_pton(AF_INET6, text.c_str(), e.address.data()) == 1) return e;
+    return std::nullopt;
+}
+
+bool Endpoint::is_v4() const {
+    return std::memcmp(address.data(), V4_MAPPED, sizeof(V4_MAPPED)) == 0;
+}
+
+const uint8_t *Endpoint::address_bytes() const {
+    return is_v4() ? address.data() + 12 : address.data();
+}
+
+size_t Endpoint::address_length() const {
+    return is_v4() ? 4 : 16;
+}
+
+socklen_t Endpoint::to_sockaddr(int family, sockaddr_storage &out) const {
+    if (family == AF_INET6) {
+        sockaddr_in6 &a = reinterpret_cast<sockaddr_in6 &>(out);
+        a = sockaddr_in6{};
+        a.sin6_family = AF_INET6;
+        a.sin6_port = port_be;
+        std::memcpy(&a.sin6_addr, address.data(), 16);
+        return sizeof(sockaddr_in6);
+    }
+    if (family == AF_INET && is_v4()) {
+        sockaddr_in &a = reinterpret_cast<sockaddr_in &>(out);
+        a = sockaddr_in{};
+        a.sin_family = AF_INET;
+        a.sin_port = port_be;
+        std::memcpy(&a.sin_addr, address.data() + 12, 4);
+        return sizeof(sockaddr_in);
+    }
+    return 0;
+}
+
+std::string Endpoint::to_string() const {
+    char buf[INET6_ADDRSTRLEN];
+    if (is_v4()) {
+        inet_ntop(AF_INET, address.data() + 12, buf, sizeof(buf));
+        return std::string(buf) + ":" + std::to_string(port());
+    }
+    inet_ntop(AF_INET6, address.data(), buf, sizeof(buf));
+    return "[" + std::string(buf) + "]:" + std::to_string(port());
+}
+
+// The two halves of the address are folded with the port and mixed once,
+// so v4-mapped addresses, whose first half is constant, still spread well.
+size_t Endpoint::Hash::operator()(const Endpoint &e) const {
+    uint64_t hi, lo;
+    std::memcpy(&hi, e.address.data(), 8);
+    std::memcpy(&lo, e.address.data() + 8, 8);
+    uint64_t h = (hi * 0x9E3779B97F4A7C15ull) ^ lo ^ (static_cast<uint64_t>(e.port_be) << 48);
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    return static_cast<size_t>(h);
+}
@@ -0,0 +1,74 @@
+#ifndef ENDPOINT_H
+#define ENDPOINT_H
+
+#include <array>
+#include <compare>
+#include <cstdint>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+// The Endpoint class is a peer's UDP address, IPv4 or IPv6, in 18 bytes: a
+// 16-byte IPv6 address, with IPv4 held as a v4-mapped address
+// (::ffff:a.b.c.d), and the port in network byte order. Both families
+// compare and hash the same way, with a few word operations and no string
+// conversion, so peer lookups cost the same in IPv6 deployments.
+//
+// A dual-stack (AF_INET6) socket reports IPv4 senders in the same v4-mapped
+// form, so an endpoint read from either kind of socket compares equal to the
+// one parsed from the peer's dotted address.
+class Endpoint {
+public:
+    // The unspecified address, port 0.
+    Endpoint() = default;
+
+    explicit Endpoint(const sockaddr_in &addr);
+    explicit Endpoint(const sockaddr_in6 &addr);
+
+    // Reads an AF_INET or AF_INET6 address, as filled in by recvfrom.
+    static std::optional<Endpoint> from_sockaddr(const sockaddr_storage &addr);
+
+    // Builds an endpoint from the address bytes of a node record: 4 bytes
+    // for IPv4 or 16 for IPv6, and the port in network byte order.
+    static std::optional<Endpoint> from_bytes(const uint8_t *bytes, size_t length,
+                                              uint16_t network_port);
+
+    // Parses a numeric IPv4 or IPv6 address; port is in host byte order.
+    static std::optional<Endpoint> parse(const std::string &address, uint16_t port);
+
+    // Returns true for an IPv4 (v4-mapped) address.
+    bool is_v4() const;
+
+    // Returns the address as carried in node records: 4 bytes for IPv4,
+    // 16 for IPv6.
+    const uint8_t *address_bytes() const;
+    size_t address_length() const;
+
+    uint16_t port() const { return ntohs(port_be); }
+    uint16_t network_port() const { return port_be; }
+
+    // Writes the endpoint as a socket address for a socket of the given
+    // family: AF_INET6 takes IPv4 in v4-mapped form, AF_INET only takes
+    // IPv4. Returns the address length, or 0 if the family cannot reach it.
+    socklen_t to_sockaddr(int family, sockaddr_storage &out) const;
+
+    // Returns "a.b.c.d:port" or "[v6]:port".
+    std::string to_string() const;
+
+    // Endpoints order by address bytes, then port, which gives a fixed
+    // tie-break between peers.
+    bool operator==(const Endpoint &other) const = default;
+    auto operator<=>(const Endpoint &other) const = default;
+
+    struct Hash {
+        size_t operator()(const Endpoint &e) const;
+    };
+
+private:
+    std::array<uint8_t, 16> address{};
+    uint16_t port_be = 0;
+};
+
+#endif // ENDPOINT_H
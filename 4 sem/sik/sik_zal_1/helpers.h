@@ -17,11 +17,17 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <vector>
+#include <algorithm>
+#include <functional>
+#include <optional>
 
 #include "err.h"
-#include "list.h"
 #include "message.h"
+#include "batch_io.h"
+#include "endpoint.h"
+#include "sync_node.h"
 
 namespace helpers {
 
@@ -32,16 +38,10 @@ struct Options {
     uint16_t port = 0;
     std::string peer_address;
     uint16_t peer_port = 0;
-};
-
-// Structure representing a peer node used for synchronization logic.
-// It tracks whether the node exists, its address, port, sync level, and last contact time.
-struct Node {
-    bool does_exist = false;
-    uint16_t port = 0;
-    std::string address;
-    int synchronization = 255;
-    std::chrono::steady_clock::time_point last_heard = std::chrono::steady_clock::now();
+    size_t fanout = 0;          // Children served at most; 0 for no limit.
+    bool electable = false;     // May run for leader when the leader is lost.
+    std::string time_page;      // Shared memory object to publish time in, if any.
+    double get_time_rate = SyncNode::GET_TIME_RATE;  // Per sender; 0 for no limit.
 };
 
 // Converts a C-string to a valid port number. It terminates the program on invalid input.
@@ -55,25 +55,82 @@ inline uint16_t read_port(const char *str) {
     return static_cast<uint16_t>(val);
 }
 
+// Converts a C-string to a fan-out limit. It terminates the program on invalid input.
+inline size_t read_fanout(const char *str) {
+    char *endptr;
+    errno = 0;
+    unsigned long val = strtoul(str, &endptr, 10);
+    if (errno != 0 || *endptr != '\0' || *str == '-' || val > UINT16_MAX) {
+        fatal("not valid fanout");
+    }
+    return val;
+}
+
+// Converts a C-string to a GET_TIME rate limit. It terminates the program on invalid input.
+inline double read_rate(const char *str) {
+    char *endptr;
+    errno = 0;
+    double val = strtod(str, &endptr);
+    if (errno != 0 || *endptr != '\0' || endptr == str || !(val >= 0)) {
+        fatal("not valid rate");
+    }
+    return val;
+}
+
 // Parses the command-line arguments and populates the Options struct accordingly.
 inline void parse_arguments(int argc, char *argv[], Options &opts) {
     int ch;
-    while ((ch = getopt(argc, argv, "b:p:a:r:")) != -1) {
+    while ((ch = getopt(argc, argv, "b:p:a:r:f:es:l:")) != -1) {
         switch (ch) {
             case 'b': opts.bind_address = optarg; break;
             case 'p': opts.port = read_port(optarg); break;
             case 'a': opts.peer_address = optarg; break;
             case 'r': opts.peer_port = read_port(optarg); break;
+            case 'f': opts.fanout = read_fanout(optarg); break;
+            case 'e': opts.electable = true; break;
+            case 'l': opts.get_time_rate = read_rate(optarg); break;
+            case 's': opts.time_page = optarg[0] == '/' ? optarg : "/" + std::string(optarg); break;
             default: fatal("wrong flag");
         }
     }
 }
 
+// Returns true if the configured bind address means every local address.
+inline bool binds_any(const Options &opts) {
+    return opts.bind_address == "0.0.0.0" || opts.bind_address == "::";
+}
+
+// Converts the configured bind address (IPv4 or IPv6) and port into an
+// Endpoint. Terminates the program if the address is not valid.
+inline Endpoint bind_endpoint(const Options &opts) {
+    auto addr = Endpoint::parse(binds_any(opts) ? "::" : opts.bind_address, opts.port);
+    if (!addr) syserr("invalid bind address");
+    return *addr;
+}
+
 // Creates a non-blocking UDP socket and binds it to the specified address and port.
+// With the default bind address the socket is dual-stack (AF_INET6 with
+// IPV6_V6ONLY off): it serves IPv4 and IPv6 peers alike and reports IPv4
+// senders as v4-mapped addresses. Where the kernel has no IPv6 it falls back
+// to an AF_INET socket, which is also used for a specific IPv4 bind address.
+// The family is stored in family.
 // On any system error, the program is terminated.
-inline int create_and_bind_socket(const Options &opts) {
-    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+inline int create_and_bind_socket(const Options &opts, int &family) {
+    Endpoint local = bind_endpoint(opts);
+    family = local.is_v4() ? AF_INET : AF_INET6;
+    int fd = socket(family, SOCK_DGRAM, 0);
+    if (fd < 0 && errno == EAFNOSUPPORT && binds_any(opts)) {
+        family = AF_INET;
+        local = *Endpoint::parse("0.0.0.0", opts.port);
+        fd = socket(AF_INET, SOCK_DGRAM, 0);
+    }
     if (fd < 0) syserr("cannot create socket");
+    if (family == AF_INET6) {
+        int off = 0;
+        if (setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off)) < 0) {
+            syserr("setsockopt IPV6_V6ONLY");
+        }
+    }
     int flags = fcntl(fd, F_GETFL, 0);
     if (flags < 0) {
         syserr("fcntl F_GETFL");
@@ -82,169 +139,91 @@ inline int create_and_bind_socket(const Options &opts) {
         syserr("fcntl F_SETFL");
     }
 
+    sockaddr_storage addr;
+    socklen_t addr_len = local.to_sockaddr(family, addr);
 
-    sockaddr_in addr{};
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(opts.port);
-    if (opts.bind_address == "0.0.0.0") {
-        addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    } else if (inet_pton(AF_INET, opts.bind_address.c_str(), &addr.sin_addr) <= 0) {
-        syserr("invalid bind address");
-    }
-
-    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), addr_len) < 0) {
         syserr("bind failed on");
     }
+    // Kernel receive timestamps are optional; without them T2 and T4 are
+    // read right after recvmmsg returns.
+    if (!enable_receive_timestamps(fd)) {
+        error("SO_TIMESTAMPNS not available");
+    }
     return fd;
 }
 
-// Sends an initial HELLO message to the configured peer, if any peer was specified.
-inline void send_initial_hello(int socket_fd, const Options &opts) {
-    if (opts.peer_address.empty() || opts.peer_port == 0) return;
-    sockaddr_in dest{};
-    dest.sin_family = AF_INET;
-    dest.sin_port = htons(opts.peer_port);
-    if (inet_pton(AF_INET, opts.peer_address.c_str(), &dest.sin_addr) <= 0) {
-        syserr("invalid peer address");
-    }
-    Message msg = make_HELLO();
-    auto buf = serialize(msg);
-    if (sendto(socket_fd, buf.data(), buf.size(), 0,
-               reinterpret_cast<sockaddr*>(&dest), sizeof(dest)) < 0) {
-        syserr("sendto HELLO failed");
-    }
+// Returns the address of the peer configured with -a/-r, if any.
+// Terminates the program if the address is not a valid IPv4 or IPv6 address.
+inline std::optional<Endpoint> contact_endpoint(const Options &opts) {
+    if (opts.peer_address.empty() || opts.peer_port == 0) return std::nullopt;
+    auto dest = Endpoint::parse(opts.peer_address, opts.peer_port);
+    if (!dest) syserr("invalid peer address");
+    return dest;
 }
 
-// Checks whether the current synchronization source has timed out.
-// If the node fails to respond within 20 seconds, it is invalidated.
-inline void check_source_timeout(Node &src, bool leader, int &synchronization) {
-    auto now = std::chrono::steady_clock::now();
-    if (!leader && src.does_exist &&
-        std::chrono::duration_cast<std::chrono::seconds>(now - src.last_heard) > std::chrono::seconds(20)) {
-        src.does_exist = false;
-        synchronization = 255;
-    }
+// Returns how long the main loop may block in poll() before deadline, the
+// node's next timer. Returns -1 (wait indefinitely) when nothing is due.
+inline int poll_timeout_ms(SyncClock::time_point deadline) {
+    using namespace std::chrono;
+    if (deadline == SyncClock::time_point::max()) return -1;
+    auto now = SyncClock::now();
+    if (deadline <= now) return 0;
+    // Round up so we never wake just before the deadline and spin.
+    auto wait = duration_cast<milliseconds>(deadline - now + milliseconds(1) - nanoseconds(1));
+    return static_cast<int>(std::min<milliseconds::rep>(wait.count(), INT_MAX));
 }
 
-// Serializes a Message, sends it over UDP, and returns false on any error.
-inline bool send_message(int socket_fd,
-    const Message &msg,
-    const sockaddr_in &dest,
+// Sends len bytes of data to dest over UDP and returns false on any error.
+// family is the socket's address family.
+inline bool send_bytes(int socket_fd, int family,
+    const uint8_t *data, size_t len,
+    const Endpoint &dest,
     const std::string &what) {
-    try {
-        auto buf = serialize(msg);
-        ssize_t sent = sendto(socket_fd,
-                reinterpret_cast<const char*>(buf.data()), buf.size(),
-                0,
-                reinterpret_cast<const sockaddr*>(&dest),
-                sizeof(dest));
-        if (sent < 0) {
-            error("sendto failed for " + what);
-            return false;
-        }
-        return true;
-    } catch (const std::exception &ex) {
-        // np. przekroczono rozmiar UDP albo za dużo węzłów
-        error(std::string("send_message: ") + ex.what());
+    sockaddr_storage addr;
+    socklen_t addr_len = dest.to_sockaddr(family, addr);
+    if (addr_len == 0) {
+        error("no route to " + dest.to_string() + " for " + what);
         return false;
     }
-}
-
-// Sends SYNC_START messages to all known peers every 5 seconds if not fully synchronized.
-inline void try_send_start_sync(int socket_fd,
-                                ListOfSockaddr &addrList,
-                                int &synchronization,
-                                std::chrono::steady_clock::time_point &last_start,
-                                std::chrono::steady_clock::time_point start_time,
-                                std::chrono::steady_clock::duration offset) {
-    auto now = std::chrono::steady_clock::now();
-    if (synchronization < 254 &&
-        std::chrono::duration_cast<std::chrono::seconds>(now - last_start) > std::chrono::seconds(5)) {
-        last_start = now;
-        for (size_t i = 0; i < addrList.size(); ++i) {
-            sockaddr_in dest = addrList.getElement(i);
-            Message msg = make_SYNC_START(synchronization, start_time, offset);
-            send_message(socket_fd, msg, dest, "SYNC_START");
-        }
-    }
-}
-
-// Returns true if the given ip and port match a known peer in addrList.
-inline bool is_known_peer(const ListOfSockaddr &addrList,
-                          const std::string &ip,
-                          uint16_t port) {
-    for (size_t i = 0; i < addrList.size(); ++i) {
-        const sockaddr_in &peer = addrList.getElement(i);
-        if (ntohs(peer.sin_port) != port) continue;
-        char buf[INET_ADDRSTRLEN];
-        if (inet_ntop(AF_INET, &peer.sin_addr, buf, sizeof(buf)) && ip == buf) {
-            return true;
-        }
+    ssize_t sent = sendto(socket_fd, data, len, 0,
+            reinterpret_cast<const sockaddr*>(&addr),
+            addr_len);
+    if (sent < 0) {
+        error("sendto failed for " + what);
+        return false;
     }
-    return false;
+    return true;
 }
 
-// Validates the contacts array in a HELLO_REPLY and adds them only if all records are valid.
-inline bool handle_hello_reply_contacts(const Message &recvMsg,
-    const std::string &sender_ip,
-    uint16_t sender_port,
-    const std::string &local_ip,
-    uint16_t local_port,
-    ListOfSockaddr &receivedContacts) 
-{
-    // 1) Count must match actual number of nodes.
-    if (recvMsg.nodes.size() != recvMsg.count) return false;
-
-    // Temporary storage for validated contacts.
-    std::vector<std::pair<std::string,uint16_t>> temp;
-    temp.reserve(recvMsg.count);
-
-    for (auto const &rec : recvMsg.nodes) {
-        // 2) peer_address_length matches vector size and equals 4 (IPv4).
-        if (rec.peer_address_length != rec.peer_address.size()) return false;
-        uint16_t port = ntohs(rec.peer_port);
-        // 3) peer_port must be non-zero
-        if (port == 0) return false;
-
-        // 4) Convert raw address to string.
-        char ip_str[INET_ADDRSTRLEN];
-        sockaddr_in inaddr{};
-        memcpy(&inaddr.sin_addr, rec.peer_address.data(), rec.peer_address_length);
-        if (!inet_ntop(AF_INET, &inaddr.sin_addr, ip_str, sizeof(ip_str))) return false;
-        std::string ip(ip_str);
-
-        // 5) Exclude sender and local bind address.
-        if ((ip == sender_ip && port == sender_port) ||
-            (ip == local_ip  && port == local_port)) {
-            return false;
-        }
+// The SocketTransport class sends a SyncNode's datagrams over a UDP socket,
+// fanning out with sendmmsg.
+class SocketTransport : public SyncNode::Transport {
+public:
+    SocketTransport(int fd, int socket_family) : socket_fd(fd), family(socket_family) {}
 
-        // 6) Valid record: save for later.
-        temp.emplace_back(ip, port);
+    bool send(const uint8_t *data, size_t len, const Endpoint &dest) override {
+        return send_bytes(socket_fd, family, data, len, dest, "datagram");
     }
 
-    // All records validated: add them to receivedContacts.
-    for (auto const &entry : temp) {
-        receivedContacts.add(entry.first.c_str(), entry.second);
+    size_t send_to_all(const std::vector<Endpoint> &destinations,
+                       const uint8_t *data, size_t len,
+                       const std::function<void()> &before_batch) override {
+        return ::send_to_all(socket_fd, family, destinations, data, len, before_batch);
     }
 
-    return true;
-}
-// Sends CONNECT messages to all contacts stored in receivedContacts and clears the list.
-inline bool send_connects(int socket_fd,
-                          ListOfSockaddr &receivedContacts) {
-    bool result = true;
-    while (receivedContacts.size() > 0) {
-        sockaddr_in contact = receivedContacts.getElement(0);
-        Message connectMsg = make_CONNECT();
-        if(!send_message(socket_fd, connectMsg, contact, "CONNECT")){
-            error("message not send");
-            result = false;
-        };
-        receivedContacts.remove(0);
+private:
+    int socket_fd;
+    int family;
+};
+
+// The SystemClock class gives a SyncNode the real SyncClock.
+class SystemClock : public SyncNode::Clock {
+public:
+    SyncClock::time_point now() override {
+        return SyncClock::now();
     }
-    return result;
-}
+};
 
 } // namespace helpers
 
@@ -0,0 +1,118 @@
+#include "membership.h"
+#include <algorithm>
+
+Membership::Membership(const Endpoint &self_addr, uint64_t seed)
+    : self(self_addr), rng(seed) {}
+
+size_t Membership::pick(size_t n) {
+    return std::uniform_int_distribution<size_t>(0, n - 1)(rng);
+}
+
+void Membership::forget(size_t index) {
+    known[index] = known.back();
+    known.pop_back();
+}
+
+size_t Membership::count(bool gossip) const {
+    size_t n = 0;
+    for (size_t i = 0; i < neighbours.size(); ++i) {
+        if (neighbours[i].gossip == gossip) ++n;
+    }
+    return n;
+}
+
+bool Membership::admit(const Endpoint &peer, Precision precision, bool gossip, bool forced,
+                       SyncClock::time_point now, std::optional<Endpoint> &evicted) {
+    evicted.reset();
+    if (peer == self) return false;
+
+    if (!neighbours.contains(peer) && !gossip && count(false) >= LEGACY_VIEW) return false;
+    if (!neighbours.contains(peer) && gossip && count(true) >= ACTIVE_VIEW) {
+        // Only gossip neighbours can be asked to leave.
+        std::vector<size_t> candidates;
+        for (size_t i = 0; i < neighbours.size(); ++i) {
+            if (neighbours[i].gossip) candidates.push_back(i);
+        }
+        if (!forced) return false;
+        Endpoint victim = neighbours[candidates[pick(candidates.size())]].address;
+        demote(victim);
+        evicted = victim;
+    }
+
+    neighbours.add(peer, precision, now);
+    neighbours.find(peer)->gossip = gossip;
+
+    // A neighbour is not kept in the passive view as well.
+    auto it = std::find(known.begin(), known.end(), peer);
+    if (it != known.end()) forget(static_cast<size_t>(it - known.begin()));
+    return true;
+}
+
+bool Membership::demote(const Endpoint &peer) {
+    const PeerState *state = neighbours.find(peer);
+    if (!state) return false;
+    Endpoint address = state->address;
+    neighbours.remove(peer);
+    remember(address);
+    return true;
+}
+
+std::vector<Endpoint> Membership::expire(SyncClock::time_point since) {
+    std::vector<Endpoint> silent;
+    for (size_t i = 0; i < neighbours.size(); ++i) {
+        if (neighbours[i].last_heard < since) silent.push_back(neighbours[i].address);
+    }
+    for (const auto &peer : silent) demote(peer);
+    return silent;
+}
+
+void Membership::remember(const Endpoint &peer) {
+    if (peer == self || neighbours.contains(peer)) return;
+    if (std::find(known.begin(), known.end(), peer) != known.end()) return;
+    if (known.size() >= PASSIVE_VIEW) forget(pick(known.size()));
+    known.push_back(peer);
+}
+
+std::vector<Endpoint> Membership::sample(size_t n, const Endpoint &except) {
+    std::vector<Endpoint> pool;
+    pool.reserve(neighbours.size() + known.size());
+    for (const auto &a : neighbours.addresses()) {
+        if (a != except) pool.push_back(a);
+    }
+    for (const auto &a : known) {
+        if (a != except) pool.push_back(a);
+    }
+    // Partial Fisher-Yates: the first n entries end up a uniform sample.
+    n = std::min(n, pool.size());
+    for (size_t i = 0; i < n; ++i) {
+        std::swap(pool[i], pool[i + pick(pool.size() - i)]);
+    }
+    pool.resize(n);
+    return pool;
+}
+
+std::vector<Endpoint> Membership::sample_passive(size_t n) {
+    std::vector<Endpoint> pool = known;
+    n = std::min(n, pool.size());
+    for (size_t i = 0; i < n; ++i) {
+        std::swap(pool[i], pool[i + pick(pool.size() - i)]);
+    }
+    pool.resize(n);
+    return pool;
+}
+
+std::optional<Endpoint> Membership::random_neighbour(const std::vector<Endpoint> &skip) {
+    std::vector<Endpoint> candidates;
+    for (size_t i = 0; i < neighbours.size(); ++i) {
+        const PeerState &peer = neighbours[i];
+        bool skipped = std::find(skip.begin(), skip.end(), peer.address) != skip.end();
+        if (peer.gossip && !skipped) candidates.push_back(peer.address);
+    }
+    if (candidates.empty()) return std::nullopt;
+    return candidates[pick(candidates.size())];
+}
+
+std::optional<Endpoint> Membership::repair_target() {
+    if (count(true) >= ACTIVE_VIEW || known.empty()) return std::nullopt;
+    return known[pick(known.size())];
+}
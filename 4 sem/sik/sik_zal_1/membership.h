@@ -0,0 +1,113 @@
+#ifndef MEMBERSHIP_H
+#define MEMBERSHIP_H
+
+#include <cstdint>
+#include <cstddef>
+#include <optional>
+#include <random>
+#include <vector>
+
+#include "message.h"
+#include "peer_table.h"
+#include "sync_clock.h"
+#include "endpoint.h"
+
+// The Membership class is a node's partial view of the cluster, after
+// HyParView. The active view is a small PeerTable of neighbours: the peers
+// that get SYNC_START and may be synchronized to. The passive view is a
+// larger list of addresses known to be in the cluster, used to replace
+// neighbours that leave and refreshed by periodic SHUFFLE exchanges.
+//
+// A joiner's contact starts a random walk of FORWARD_JOIN from each of its
+// neighbours; the node where a walk ends takes the joiner as a neighbour.
+// Both views are bounded, so a join costs about ACTIVE_VIEW * ACTIVE_WALK
+// messages whatever the cluster size, and the walks keep the active views a
+// well-mixed graph of constant degree, over which SYNC_START reaches every
+// node in about log N hops.
+//
+// Membership only keeps the views and picks peers; SyncNode sends the messages.
+class Membership {
+public:
+    // Gossip neighbours kept in the active view.
+    static constexpr size_t ACTIVE_VIEW = 8;
+
+    // Neighbours without CAPABILITY_GOSSIP kept in the active view besides
+    // those. They cannot be told to leave, so once this many are in, others
+    // are refused rather than making room.
+    static constexpr size_t LEGACY_VIEW = 8;
+
+    // Addresses kept in the passive view.
+    static constexpr size_t PASSIVE_VIEW = 32;
+
+    // Contacts listed in a HELLO_REPLY to a gossip node and in a SHUFFLE.
+    static constexpr size_t SAMPLE = 8;
+
+    // Hops of a FORWARD_JOIN walk, and the hop after which the nodes it
+    // passes remember the joiner as a passive peer.
+    static constexpr uint8_t ACTIVE_WALK = 6;
+    static constexpr uint8_t PASSIVE_WALK = 3;
+
+    // Contacts from the HELLO_REPLY of a node without gossip, which starts
+    // no walks, that a joiner sends a forced CONNECT to; the others go to its
+    // passive view.
+    static constexpr size_t JOIN_CONNECTS = 3;
+
+    Membership(const Endpoint &self, uint64_t seed);
+
+    // Adds peer to the active view. If the view has ACTIVE_VIEW gossip
+    // neighbours, a forced admission evicts a random one, which is moved to
+    // the passive view and returned in evicted, while a non-forced one is
+    // refused. Peers without gossip are refused once there are LEGACY_VIEW of
+    // them. A peer already in the view stays there and only has its precision
+    // updated. Returns false if the peer was refused.
+    bool admit(const Endpoint &peer, Precision precision, bool gossip, bool forced,
+               SyncClock::time_point now, std::optional<Endpoint> &evicted);
+
+    // Moves peer from the active to the passive view. Returns false if it
+    // was not a neighbour.
+    bool demote(const Endpoint &peer);
+
+    // Moves the neighbours last heard before since to the passive view, as
+    // they may have crashed, and returns them.
+    std::vector<Endpoint> expire(SyncClock::time_point since);
+
+    // Adds peer to the passive view unless it is this node, a neighbour or
+    // already there. When the view is full a random entry makes room.
+    void remember(const Endpoint &peer);
+
+    // Returns up to n distinct random addresses from both views, never except.
+    std::vector<Endpoint> sample(size_t n, const Endpoint &except);
+
+    // Returns up to n distinct random addresses from the passive view.
+    std::vector<Endpoint> sample_passive(size_t n);
+
+    // Returns a random gossip neighbour other than those in skip, if any: a
+    // peer to SHUFFLE with or to pass a FORWARD_JOIN to.
+    std::optional<Endpoint> random_neighbour(const std::vector<Endpoint> &skip = {});
+
+    // Returns a random passive peer to CONNECT to when the active view has
+    // room for a gossip neighbour, if any. The peer stays passive until it
+    // accepts.
+    std::optional<Endpoint> repair_target();
+
+    PeerTable &active() { return neighbours; }
+    const PeerTable &active() const { return neighbours; }
+    const std::vector<Endpoint> &passive() const { return known; }
+
+private:
+    // Returns a random index below n, which must be positive.
+    size_t pick(size_t n);
+
+    // Removes the passive entry at index.
+    void forget(size_t index);
+
+    // Returns the number of neighbours with or without gossip.
+    size_t count(bool gossip) const;
+
+    const Endpoint self;
+    PeerTable neighbours;
+    std::vector<Endpoint> known;
+    std::mt19937_64 rng;
+};
+
+#endif // MEMBERSHIP_H
@@ -1,7 +1,9 @@
 #include "message.h"
-#include "list.h"
 #include <chrono>
 #include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <algorithm>
 #include <arpa/inet.h>  // htons, ntohs
 #include <endian.h>     // htobe64, be64toh
 
@@ -9,6 +11,54 @@ using namespace std;
 using namespace std::chrono;
 
 
+// Returns the node's clock reading at `at`: time since start_time, corrected
+// by offset unless the node is the leader (0) or unsynchronized (255).
+nanoseconds clock_reading(int synchronized,
+                          SyncClock::time_point start_time,
+                          nanoseconds offset,
+                          SyncClock::time_point at) {
+    auto base_offset = (synchronized == 0 || synchronized == 255)
+                       ? nanoseconds(0)
+                       : offset;
+    return at - start_time - base_offset;
+}
+
+uint64_t to_wire(nanoseconds reading, Precision precision) {
+    if (precision == Precision::NANOSECONDS) {
+        return static_cast<uint64_t>(reading.count());
+    }
+    return static_cast<uint64_t>(duration_cast<milliseconds>(reading).count());
+}
+
+nanoseconds from_wire(uint64_t timestamp, Precision precision) {
+    if (precision == Precision::NANOSECONDS) {
+        return nanoseconds(static_cast<nanoseconds::rep>(timestamp));
+    }
+    return milliseconds(static_cast<milliseconds::rep>(timestamp));
+}
+
+uint64_t current_timestamp(int synchronized,
+                           SyncClock::time_point start_time,
+                           nanoseconds offset,
+                           Precision precision) {
+    return to_wire(clock_reading(synchronized, start_time, offset, SyncClock::now()), precision);
+}
+
+// Writes a timestamp into out[0..7] exactly as serialize() encodes it.
+void encode_timestamp(uint8_t *out, uint64_t timestamp) {
+    uint64_t ts_n = htobe64(timestamp);
+    for (int i = 7; i >= 0; --i) {
+        *out++ = static_cast<uint8_t>((ts_n >> (i*8)) & 0xFF);
+    }
+}
+
+// Reads a timestamp from in[0..7], undoing encode_timestamp().
+uint64_t decode_timestamp(const uint8_t *in) {
+    uint64_t ts = 0;
+    for (int i = 0; i < 8; ++i) ts = (ts << 8) | in[i];
+    return be64toh(ts);
+}
+
 // Factory functions to construct protocol messages of various types.
 // Each function initializes the fields appropriately and returns a Message.
 
@@ -17,45 +67,54 @@ Message make_HELLO() {
     res.message = 1;
     res.nodes.clear();
     res.refresh_count();
-    res.timestamp = 0;
+    res.timestamp = NODE_CAPABILITIES;
     res.synchronized = 0;
     return res;
 }
 
-Message make_HELLO_REPLY(const ListOfSockaddr &contacts) {
+// Builds a message of the given type whose node list holds contacts.
+static Message make_contacts(uint8_t type, const std::vector<Endpoint> &addrList) {
     Message res{};
-    res.message = 2;
+    res.message = type;
     res.nodes.clear();
 
-    // Get the list of sockaddr_in entries from our contacts object.
-    const auto &addrList = contacts.getList();
     // We cannot encode more than 65535 entries.
     size_t numContacts = std::min(addrList.size(), static_cast<size_t>(UINT16_MAX));
 
     for (size_t i = 0; i < numContacts; ++i) {
-        const auto &sin = addrList[i];
+        const Endpoint &peer = addrList[i];
         NodeRecord nr;
-        constexpr size_t ADDR_LEN = sizeof(sin.sin_addr.s_addr);
-        const uint8_t *rawBytes = reinterpret_cast<const uint8_t *>(&sin.sin_addr.s_addr);
-        nr.peer_address.assign(rawBytes, rawBytes + ADDR_LEN);
+        const uint8_t *rawBytes = peer.address_bytes();
+        nr.peer_address.assign(rawBytes, rawBytes + peer.address_length());
         nr.peer_address_length = static_cast<uint8_t>(nr.peer_address.size());
-        nr.peer_port = sin.sin_port;
+        nr.peer_port = peer.network_port();
         res.nodes.push_back(std::move(nr));
     }
     res.refresh_count();
-    res.timestamp    = 0;
+    res.timestamp    = NODE_CAPABILITIES;
     res.synchronized = 0;
     return res;
 }
 
+Message make_HELLO_REPLY(const std::vector<Endpoint> &addrList) {
+    return make_contacts(2, addrList);
+}
+
+Message make_SHUFFLE(const std::vector<Endpoint> &contacts) {
+    return make_contacts(SHUFFLE, contacts);
+}
 
-Message make_CONNECT() {
+Message make_SHUFFLE_REPLY(const std::vector<Endpoint> &contacts) {
+    return make_contacts(SHUFFLE_REPLY, contacts);
+}
+
+Message make_CONNECT(bool forced) {
     Message res{};
     res.message = 3;
     res.nodes.clear();
     res.refresh_count();
-    res.timestamp = 0;
-    res.synchronized = 0;
+    res.timestamp = NODE_CAPABILITIES;
+    res.synchronized = forced ? CONNECT_FORCED : 0;
     return res;
 }
 
@@ -64,35 +123,46 @@ Message make_ACK_CONNECT() {
     res.message = 4;
     res.nodes.clear();
     res.refresh_count();
-    res.timestamp = 0;
+    res.timestamp = NODE_CAPABILITIES;
+    res.synchronized = 0;
+    return res;
+}
+
+Message make_DISCONNECT() {
+    Message res{};
+    res.message = DISCONNECT;
+    res.nodes.clear();
+    res.refresh_count();
+    res.timestamp = NODE_CAPABILITIES;
     res.synchronized = 0;
     return res;
 }
 
-Message make_GET_TIME() {
+Message make_GET_TIME(uint64_t capabilities) {
     Message res{};
     res.message = 31;
     res.nodes.clear();
     res.refresh_count();
-    res.timestamp = 0;
+    res.timestamp = capabilities;
     res.synchronized = 0;
     return res;
 }
 
 Message make_TIME(int synchronized,
-                 steady_clock::time_point start_time,
-                 steady_clock::duration offset) {
+                  SyncClock::time_point start_time,
+                  nanoseconds offset,
+                  Precision precision,
+                  uint64_t accuracy_ns,
+                  SyncClock::time_point at) {
     Message res{};
     res.message = 32;
     res.nodes.clear();
+    if (precision == Precision::NANOSECONDS) {
+        res.nodes.push_back(make_precision_record(accuracy_ns));
+    }
     res.refresh_count();
     res.synchronized = static_cast<uint8_t>(synchronized);
-    auto now = steady_clock::now();
-    auto base_offset = (synchronized == 0 || synchronized == 255)
-                       ? milliseconds(0)
-                       : duration_cast<milliseconds>(offset);
-    auto elapsed = duration_cast<milliseconds>(now - start_time - base_offset);
-    res.timestamp = static_cast<uint64_t>(elapsed.count());
+    res.timestamp = to_wire(clock_reading(synchronized, start_time, offset, at), precision);
     return res;
 }
 
@@ -107,19 +177,19 @@ Message make_LEADER(int synchronized) {
 }
 
 Message make_SYNC_START(int synchronized,
-                       steady_clock::time_point start_time,
-                       steady_clock::duration offset) {
+                        SyncClock::time_point start_time,
+                        nanoseconds offset,
+                        Precision precision,
+                        uint64_t accuracy_ns) {
     Message res{};
     res.message = 11;
     res.nodes.clear();
+    if (precision == Precision::NANOSECONDS) {
+        res.nodes.push_back(make_precision_record(accuracy_ns));
+    }
     res.refresh_count();
     res.synchronized = static_cast<uint8_t>(synchronized);
-    auto now = steady_clock::now();
-    auto base_offset = (synchronized == 0 || synchronized == 255)
-                       ? milliseconds(0)
-                       : duration_cast<milliseconds>(offset);
-    auto elapsed = duration_cast<milliseconds>(now - start_time - base_offset);
-    res.timestamp = static_cast<uint64_t>(elapsed.count());
+    res.timestamp = current_timestamp(synchronized, start_time, offset, precision);
     return res;
 }
 
@@ -134,127 +204,186 @@ Message make_DELAY_REQUEST() {
 }
 
 Message make_DELAY_RESPONSE(int synchronized,
-                            steady_clock::time_point start_time,
-                            steady_clock::duration offset) {
+                            SyncClock::time_point start_time,
+                            nanoseconds offset,
+                            Precision precision,
+                            uint64_t accuracy_ns,
+                            SyncClock::time_point at) {
     Message res{};
     res.message = 13;
     res.nodes.clear();
+    if (precision == Precision::NANOSECONDS) {
+        res.nodes.push_back(make_precision_record(accuracy_ns));
+    }
     res.refresh_count();
     res.synchronized = static_cast<uint8_t>(synchronized);
-    auto now = steady_clock::now();
-    auto base_offset = (synchronized == 0 || synchronized == 255)
-                       ? milliseconds(0)
-                       : duration_cast<milliseconds>(offset);
-    auto elapsed = duration_cast<milliseconds>(now - start_time - base_offset);
-    res.timestamp = static_cast<uint64_t>(elapsed.count());
+    res.timestamp = to_wire(clock_reading(synchronized, start_time, offset, at), precision);
     return res;
 }
 
 
-// Serializes a Message into a byte vector suitable for UDP transmission.
-// It checks for node count overflow and UDP payload size limits.
-vector<uint8_t> serialize(const Message& msg_in) {
-    // Ensure count fits in 16 bits
-    if (msg_in.nodes.size() > numeric_limits<uint16_t>::max()) {
-        throw runtime_error("Too many nodes to encode (exceeds 65535)");
-    }
-
-    Message msg = msg_in;
-    msg.refresh_count();
+// Wire helpers. The 16-bit fields are written as the bytes of htons(value)
+// taken most significant first, and read back the same way.
+static uint8_t *put_u16(uint8_t *out, uint16_t value) {
+    uint16_t n = htons(value);
+    *out++ = static_cast<uint8_t>(n >> 8);
+    *out++ = static_cast<uint8_t>(n & 0xFF);
+    return out;
+}
 
-    // Compute exact total size
-    size_t total = 1   // message
-                 + 2   // count
-                 + 8   // timestamp
-                 + 1;  // synchronized
+static uint16_t get_u16(const uint8_t *in) {
+    return ntohs(static_cast<uint16_t>((static_cast<uint16_t>(in[0]) << 8) | in[1]));
+}
 
+size_t encoded_size(const Message& msg) {
+    size_t total = MESSAGE_HEADER_SIZE;
     for (auto const& nr : msg.nodes) {
         total += 1                           // peer_address_length
-               + nr.peer_address_length     // address bytes
+               + nr.peer_address.size()     // address bytes
                + 2;                          // port
     }
+    return total;
+}
 
-    // Verify that the payload will fit within a single UDP datagram.
-    constexpr size_t MAX_UDP_PAYLOAD = 65507;
-    if (total > MAX_UDP_PAYLOAD) {
-        throw runtime_error("Serialized message too large for UDP");
+size_t encode(const Message& msg, span<uint8_t> out) {
+    if (msg.nodes.size() > numeric_limits<uint16_t>::max()) return 0;
+    size_t total = encoded_size(msg);
+    if (total > MAX_UDP_PAYLOAD || total > out.size()) return 0;
+
+    uint8_t *p = out.data();
+    *p++ = msg.message;
+    p = put_u16(p, static_cast<uint16_t>(msg.nodes.size()));
+    for (auto const& nr : msg.nodes) {
+        *p++ = nr.peer_address_length;
+        if (!nr.peer_address.empty()) {
+            memcpy(p, nr.peer_address.data(), nr.peer_address.size());
+        }
+        p += nr.peer_address.size();
+        p = put_u16(p, nr.peer_port);
     }
+    encode_timestamp(p, msg.timestamp);
+    p += 8;
+    *p++ = msg.synchronized;
+    return total;
+}
 
-    vector<uint8_t> buf;
-    buf.reserve(total);
+size_t encode_HELLO_REPLY(const vector<Endpoint> &contacts, span<uint8_t> out) {
+    return encode_contacts(2, contacts, NODE_CAPABILITIES, 0, out);
+}
 
-    // Append the message type byte.
-    buf.push_back(msg.message);
+size_t encode_contacts(uint8_t message, const vector<Endpoint> &contacts,
+                       uint64_t timestamp, uint8_t synchronized, span<uint8_t> out) {
+    // Same cap as make_HELLO_REPLY: at most 65535 entries are encoded.
+    size_t count = std::min(contacts.size(), static_cast<size_t>(UINT16_MAX));
+    size_t total = MESSAGE_HEADER_SIZE;
+    for (size_t i = 0; i < count; ++i) total += 1 + contacts[i].address_length() + 2;
+    if (total > MAX_UDP_PAYLOAD || total > out.size()) return 0;
+
+    uint8_t *p = out.data();
+    *p++ = message;
+    p = put_u16(p, static_cast<uint16_t>(count));
+    for (size_t i = 0; i < count; ++i) {
+        size_t addr_len = contacts[i].address_length();
+        *p++ = static_cast<uint8_t>(addr_len);
+        memcpy(p, contacts[i].address_bytes(), addr_len);
+        p += addr_len;
+        p = put_u16(p, contacts[i].network_port());
+    }
+    encode_timestamp(p, timestamp);
+    p += 8;
+    *p++ = synchronized;
+    return total;
+}
 
-    // Append the 2-byte count in network byte order.
-    uint16_t cnt_n = htons(msg.count);
-    buf.push_back(static_cast<uint8_t>(cnt_n >> 8));
-    buf.push_back(static_cast<uint8_t>(cnt_n & 0xFF));
+NodeView MessageView::NodeIterator::operator*() const {
+    NodeView node;
+    node.peer_address_length = pos[0];
+    node.peer_address = pos + 1;
+    node.peer_port = get_u16(pos + 1 + pos[0]);
+    return node;
+}
 
-   // Append each NodeRecord sequentially.
-    for (auto const& nr : msg.nodes) {
-        buf.push_back(nr.peer_address_length);
-        buf.insert(buf.end(), nr.peer_address.begin(), nr.peer_address.end());
-        uint16_t port_n = htons(nr.peer_port);
-        buf.push_back(static_cast<uint8_t>(port_n >> 8));
-        buf.push_back(static_cast<uint8_t>(port_n & 0xFF));
-    }
+MessageView::NodeIterator &MessageView::NodeIterator::operator++() {
+    pos += 1 + pos[0] + 2;
+    return *this;
+}
 
-    // Append the 8-byte timestamp in big-endian order.
-    uint64_t ts_n = htobe64(msg.timestamp);
-    for (int i = 7; i >= 0; --i) {
-        buf.push_back(static_cast<uint8_t>((ts_n >> (i*8)) & 0xFF));
+bool MessageView::parse(const uint8_t *data, size_t len) {
+    *this = MessageView{};
+    if (len < MESSAGE_HEADER_SIZE) return false;
+
+    // Walk the node records once to check their bounds and find the timestamp.
+    uint16_t cnt = get_u16(data + 1);
+    size_t pos = 3;
+    for (uint16_t i = 0; i < cnt; ++i) {
+        if (pos >= len) return false;
+        size_t record = 1 + data[pos] + 2;
+        if (pos + record > len) return false;
+        pos += record;
     }
+    if (pos + 8 + 1 > len) return false;
+
+    type = data[0];
+    node_count = cnt;
+    nodes_begin = data + 3;
+    nodes_end = data + pos;
+    ts = decode_timestamp(data + pos);
+    sync = data[pos + 8];
+    return true;
+}
 
-    // Append the final synchronized byte.
-    buf.push_back(msg.synchronized);
-
+// Serializes a Message into a byte vector suitable for UDP transmission.
+// It checks for node count overflow and UDP payload size limits.
+vector<uint8_t> serialize(const Message& msg) {
+    if (msg.nodes.size() > numeric_limits<uint16_t>::max()) {
+        throw runtime_error("Too many nodes to encode (exceeds 65535)");
+    }
+    vector<uint8_t> buf(encoded_size(msg));
+    if (buf.size() > MAX_UDP_PAYLOAD || encode(msg, buf) == 0) {
+        throw runtime_error("Serialized message too large for UDP");
+    }
     return buf;
 }
 
 // Deserializes a byte buffer back into a Message structure.
-// It performs bounds checking and throws runtime_error on any inconsistency.
+// It validates through MessageView and throws runtime_error on any inconsistency.
 Message deserialize(const uint8_t* data, size_t len) {
-    size_t pos = 0;
-    // Verify minimal header length: message + count + timestamp + sync.
-    if (len < 1 + 2 + 8 + 1) throw runtime_error("Buffer too short");
+    MessageView view;
+    if (!view.parse(data, len)) throw runtime_error("Malformed message");
 
     Message msg;
-    msg.message = data[pos++];
-
-    // Read count and convert from network byte order.
-    uint16_t cnt_n = (static_cast<uint16_t>(data[pos]) << 8) | data[pos+1];
-    msg.count = ntohs(cnt_n);
-    pos += 2;
-
-    // Reserve space for node records and read each one.
-    msg.nodes.clear();
+    msg.message = view.message();
+    msg.count = view.count();
     msg.nodes.reserve(msg.count);
-    for (uint16_t i = 0; i < msg.count; ++i) {
-        if (pos >= len) throw runtime_error("Incomplete node data");
+    for (NodeView node : view) {
         NodeRecord nr;
-        nr.peer_address_length = data[pos++];
-        if (pos + nr.peer_address_length + 2 > len) throw runtime_error("Node record too large");
-        nr.peer_address.assign(data + pos, data + pos + nr.peer_address_length);
-        pos += nr.peer_address_length;
-        uint16_t port_n = (static_cast<uint16_t>(data[pos]) << 8) | data[pos+1];
-        nr.peer_port = ntohs(port_n);
-        pos += 2;
-        msg.nodes.push_back(move(nr));
+        nr.peer_address_length = node.peer_address_length;
+        nr.peer_address.assign(node.peer_address, node.peer_address + node.peer_address_length);
+        nr.peer_port = node.peer_port;
+        msg.nodes.push_back(std::move(nr));
     }
+    msg.timestamp = view.timestamp();
+    msg.synchronized = view.synchronized();
+    return msg;
+}
 
-    // Read the 8-byte timestamp.
-    if (pos + 8 > len) throw runtime_error("Missing timestamp");
-    uint64_t ts = 0;
-    for (int i = 0; i < 8; ++i) ts = (ts << 8) | data[pos++];
-    msg.timestamp = be64toh(ts);
-
-    // Read the final synchronized byte.
-    if (pos >= len) throw runtime_error("Missing synchronized byte");
-    msg.synchronized = data[pos++];
-
-    // Final consistency check for node count.
-    if (msg.nodes.size() != msg.count) throw runtime_error("Node count mismatch");
+// The precision record reuses the node record layout: its 8 address bytes
+// hold the accuracy in the same encoding as the timestamp field.
+NodeRecord make_precision_record(uint64_t accuracy_ns) {
+    NodeRecord nr;
+    nr.peer_address_length = PRECISION_RECORD_LENGTH;
+    nr.peer_address.resize(PRECISION_RECORD_LENGTH);
+    encode_timestamp(nr.peer_address.data(), accuracy_ns);
+    nr.peer_port = 0;
+    return nr;
+}
 
-    return msg;
-}
\ No newline at end of file
+Precision message_precision(const MessageView &msg, uint64_t &accuracy_ns) {
+    if (msg.count() != 1) return Precision::MILLISECONDS;
+    NodeView node = *msg.begin();
+    if (node.peer_address_length != PRECISION_RECORD_LENGTH || node.peer_port != 0) {
+        return Precision::MILLISECONDS;
+    }
+    accuracy_ns = decode_timestamp(node.peer_address);
+    return Precision::NANOSECONDS;
+}
@@ -4,9 +4,15 @@
 
 #include <vector>
 #include <cstdint>
+#include <cstddef>
 #include <chrono>
+#include <span>
+
+#include <netinet/in.h>
+
+#include "sync_clock.h"
+#include "endpoint.h"
 
-#include "list.h"
 // The NodeRecord structure represents a single peer's address and port information.
 // The peer_address_length field specifies the number of bytes in peer_address.
 // The peer_address vector stores the raw address bytes in network byte order.
@@ -34,6 +40,79 @@ struct Message {
     }
 };
 
+// Size of a message without nodes: type, count, timestamp, synchronized.
+constexpr size_t MESSAGE_HEADER_SIZE = 1 + 2 + 8 + 1;
+
+// Largest payload that fits in a single UDP datagram.
+constexpr size_t MAX_UDP_PAYLOAD = 65507;
+
+// Returns the number of bytes encode() writes for msg.
+size_t encoded_size(const Message& msg);
+
+// Encodes msg into out without allocating. Returns the number of bytes
+// written, or 0 if the message does not fit in out or in a UDP datagram.
+size_t encode(const Message& msg, std::span<uint8_t> out);
+
+// Encodes a HELLO_REPLY listing contacts straight into out, without building
+// NodeRecords first. IPv4 contacts take 4 address bytes, IPv6 ones 16. Produces the same bytes as
+// encode(make_HELLO_REPLY(contacts), out) and returns 0 under the same conditions.
+size_t encode_HELLO_REPLY(const std::vector<Endpoint> &contacts, std::span<uint8_t> out);
+
+// Same as encode_HELLO_REPLY for any message that carries a contact list
+// (HELLO_REPLY, SHUFFLE, SHUFFLE_REPLY), with the given type, timestamp and
+// synchronized fields.
+size_t encode_contacts(uint8_t message, const std::vector<Endpoint> &contacts,
+                       uint64_t timestamp, uint8_t synchronized, std::span<uint8_t> out);
+
+// The NodeView structure is one node record as it appears in a datagram.
+// address points into the datagram; port has the same value that
+// deserialize() stores in NodeRecord::peer_port.
+struct NodeView {
+    uint8_t        peer_address_length;
+    const uint8_t *peer_address;
+    uint16_t       peer_port;
+};
+
+// The MessageView class is a non-owning, non-throwing view over a received
+// datagram. parse() validates the whole layout once; afterwards the header
+// fields are read directly and node records are decoded lazily while
+// iterating, so nothing is copied or allocated. The datagram must outlive
+// the view.
+class MessageView {
+public:
+    // Forward iterator over the node records of a parsed message.
+    class NodeIterator {
+    public:
+        NodeIterator(const uint8_t *position) : pos(position) {}
+        NodeView operator*() const;
+        NodeIterator &operator++();
+        bool operator==(const NodeIterator &other) const { return pos == other.pos; }
+        bool operator!=(const NodeIterator &other) const { return pos != other.pos; }
+    private:
+        const uint8_t *pos;
+    };
+
+    // Validates data as a message. Returns false, leaving the view empty, if
+    // it is truncated or its node records overrun the buffer.
+    bool parse(const uint8_t *data, size_t len);
+
+    uint8_t  message() const      { return type; }
+    uint16_t count() const        { return node_count; }
+    uint64_t timestamp() const    { return ts; }
+    uint8_t  synchronized() const { return sync; }
+
+    NodeIterator begin() const { return NodeIterator(nodes_begin); }
+    NodeIterator end() const   { return NodeIterator(nodes_end); }
+
+private:
+    uint8_t        type = 0;
+    uint16_t       node_count = 0;
+    uint64_t       ts = 0;
+    uint8_t        sync = 0;
+    const uint8_t *nodes_begin = nullptr;
+    const uint8_t *nodes_end = nullptr;
+};
+
 // Serializes a Message into a vector of bytes, using network byte order
 // for multi-byte fields. Throws std::runtime_error on any size violation.
 std::vector<uint8_t> serialize(const Message& msg);
@@ -42,23 +121,132 @@ std::vector<uint8_t> serialize(const Message& msg);
 // and converting from network byte order. Throws std::runtime_error on error.
 Message deserialize(const uint8_t* data, size_t len);
 
+// The Precision enum selects the unit of the timestamp field in SYNC_START,
+// DELAY_RESPONSE and TIME: milliseconds, as in the original protocol, or
+// nanoseconds in the high-resolution mode.
+enum class Precision : uint8_t { MILLISECONDS, NANOSECONDS };
+
+// Capability bit a node advertises in the timestamp field of HELLO,
+// HELLO_REPLY, CONNECT and ACK_CONNECT, and a client in GET_TIME. Nodes that
+// predate it send 0 there and ignore the field, so they keep receiving
+// millisecond messages.
+constexpr uint64_t CAPABILITY_NANOSECONDS = 1;
+
+// Capability bit of nodes that keep a bounded partial view of the cluster
+// (see Membership). Only such peers are sent DISCONNECT and SHUFFLE, may be
+// evicted from the view, and may have a non-forced CONNECT refused.
+constexpr uint64_t CAPABILITY_GOSSIP = 2;
+
+// Capabilities this node advertises in HELLO, HELLO_REPLY, CONNECT and ACK_CONNECT.
+constexpr uint64_t NODE_CAPABILITIES = CAPABILITY_NANOSECONDS | CAPABILITY_GOSSIP;
+
+// Message types of the gossip membership, exchanged only between peers that
+// advertise CAPABILITY_GOSSIP. DISCONNECT has no records; SHUFFLE and
+// SHUFFLE_REPLY carry contacts laid out as in HELLO_REPLY. FORWARD_JOIN
+// carries the joiner as its only contact and the hops left in synchronized.
+constexpr uint8_t DISCONNECT    = 5;
+constexpr uint8_t SHUFFLE       = 6;
+constexpr uint8_t SHUFFLE_REPLY = 7;
+constexpr uint8_t FORWARD_JOIN  = 8;
+
+// Value of the synchronized field of a CONNECT that the receiver must accept
+// even if its view is full. Old nodes send 0 there.
+constexpr uint8_t CONNECT_FORCED = 1;
+
+// Leader election, also between gossip peers only (see SyncNode). ELECTION
+// carries a candidate as its only contact and the candidate's clock error
+// in nanoseconds as its timestamp. ELECTION_VETO in synchronized tells the
+// candidate that a leader is still heard of and it must stand down.
+constexpr uint8_t ELECTION      = 9;
+constexpr uint8_t ELECTION_VETO = 1;
+
+// A message whose timestamp is in nanoseconds carries exactly one precision
+// record as its node list: peer_address_length 8, the address bytes holding
+// the sender's estimated clock error in nanoseconds, encoded like the
+// timestamp field, and port 0.
+// Old nodes never receive such messages, since they do not advertise the
+// capability.
+constexpr uint8_t PRECISION_RECORD_LENGTH = 8;
+
+// Accuracy reported by a node that is not synchronized.
+constexpr uint64_t UNKNOWN_ACCURACY = UINT64_MAX;
+
+// Returns the node's clock reading at the given instant: time since
+// start_time, corrected by offset unless the node is the leader (0) or
+// unsynchronized (255).
+std::chrono::nanoseconds clock_reading(int synchronized,
+                                       SyncClock::time_point start_time,
+                                       std::chrono::nanoseconds offset,
+                                       SyncClock::time_point at);
+
+// Converts a clock reading to the timestamp field and back. Milliseconds are
+// truncated, as the original protocol did.
+uint64_t to_wire(std::chrono::nanoseconds reading, Precision precision);
+std::chrono::nanoseconds from_wire(uint64_t timestamp, Precision precision);
+
+// Returns the node's current clock reading as carried in SYNC_START,
+// DELAY_RESPONSE and TIME, in the given precision.
+uint64_t current_timestamp(int synchronized,
+                           SyncClock::time_point start_time,
+                           std::chrono::nanoseconds offset,
+                           Precision precision = Precision::MILLISECONDS);
+
+// Writes an 8-byte timestamp field in the same encoding serialize() uses.
+// Lets callers patch a pre-serialized message instead of rebuilding it.
+void encode_timestamp(uint8_t *out, uint64_t timestamp);
+
+// Reads an 8-byte field written by encode_timestamp().
+uint64_t decode_timestamp(const uint8_t *in);
+
+// Builds the precision record carrying accuracy_ns.
+NodeRecord make_precision_record(uint64_t accuracy_ns);
+
+// Returns the unit of a received message's timestamp. For nanosecond messages
+// the sender's accuracy is stored in accuracy_ns.
+Precision message_precision(const MessageView &msg, uint64_t &accuracy_ns);
+
+// Returns the precision a peer asked for through the capability bits.
+inline Precision advertised_precision(const MessageView &msg) {
+    return (msg.timestamp() & CAPABILITY_NANOSECONDS) ? Precision::NANOSECONDS
+                                                      : Precision::MILLISECONDS;
+}
+
+// Returns true if the peer runs the gossip membership.
+inline bool advertises_gossip(const MessageView &msg) {
+    return (msg.timestamp() & CAPABILITY_GOSSIP) != 0;
+}
+
 // Factory functions for creating protocol messages with appropriate initial values.
 // Each function returns a Message object with its fields set according to the protocol.
+// Nanosecond messages carry a precision record with accuracy_ns.
 Message make_HELLO();
-Message make_HELLO_REPLY(const ListOfSockaddr &contacts);
-Message make_CONNECT();
+Message make_HELLO_REPLY(const std::vector<Endpoint> &contacts);
+Message make_CONNECT(bool forced = false);
 Message make_ACK_CONNECT();
-Message make_GET_TIME();
+Message make_DISCONNECT();
+Message make_SHUFFLE(const std::vector<Endpoint> &contacts);
+Message make_SHUFFLE_REPLY(const std::vector<Endpoint> &contacts);
+Message make_GET_TIME(uint64_t capabilities = 0);
 Message make_TIME(int synchronized,
-                 std::chrono::steady_clock::time_point start_time,
-                 std::chrono::steady_clock::duration offset);
+                 SyncClock::time_point start_time,
+                 std::chrono::nanoseconds offset,
+                 Precision precision = Precision::MILLISECONDS,
+                 uint64_t accuracy_ns = UNKNOWN_ACCURACY,
+                 SyncClock::time_point at = SyncClock::now());
 Message make_LEADER(int synchronized);
 Message make_SYNC_START(int synchronized,
-                       std::chrono::steady_clock::time_point start_time,
-                       std::chrono::steady_clock::duration offset);
+                       SyncClock::time_point start_time,
+                       std::chrono::nanoseconds offset,
+                       Precision precision = Precision::MILLISECONDS,
+                       uint64_t accuracy_ns = UNKNOWN_ACCURACY);
 Message make_DELAY_REQUEST();
+// The reading is taken at `at`; for DELAY_RESPONSE normally when the
+// DELAY_REQUEST was received.
 Message make_DELAY_RESPONSE(int synchronized,
-                            std::chrono::steady_clock::time_point start_time,
-                            std::chrono::steady_clock::duration offset);
+                            SyncClock::time_point start_time,
+                            std::chrono::nanoseconds offset,
+                            Precision precision = Precision::MILLISECONDS,
+                            uint64_t accuracy_ns = UNKNOWN_ACCURACY,
+                            SyncClock::time_point at = SyncClock::now());
 
 #endif // MESSAGE_H
@@ -0,0 +1,125 @@
+#include "offset_estimator.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std::chrono;
+
+OffsetEstimator::OffsetEstimator(nanoseconds slew, nanoseconds step, bool drift_tracking)
+    : max_slew(slew), step_threshold(step), track_drift(drift_tracking) {}
+
+nanoseconds OffsetEstimator::add(nanoseconds offset, nanoseconds round_trip,
+                                 SyncClock::time_point at) {
+    // Clock granularity (millisecond peers) can make the round trip negative.
+    window[next] = Sample{offset, std::max(round_trip, nanoseconds(0)), at};
+    next = (next + 1) % WINDOW;
+    count = std::min(count + 1, WINDOW);
+
+    nanoseconds target = filtered(at);
+    nanoseconds predicted = offset_at(at);
+    nanoseconds change = target - predicted;
+    bool stepped = change > step_threshold || change < -step_threshold;
+    if (count <= SELECT || stepped) {
+        applied = target;
+    } else {
+        applied = predicted + std::clamp(change, -max_slew, max_slew);
+    }
+    applied_at = at;
+
+    // A jump is not drift, so frequency is measured afresh from it.
+    if (stepped && count > SELECT) {
+        base_at = SyncClock::time_point::min();
+        round_began = SyncClock::time_point::min();
+    }
+    if (track_drift) track(window[(next + WINDOW - 1) % WINDOW]);
+    return applied;
+}
+
+void OffsetEstimator::track(const Sample &sample) {
+    if (round_began != SyncClock::time_point::min() && sample.at - round_began >= MIN_INTERVAL) {
+        measure(round_best);
+        round_began = SyncClock::time_point::min();
+    }
+    if (round_began == SyncClock::time_point::min()) {
+        round_began = sample.at;
+        round_best = sample;
+    } else if (sample.round_trip < round_best.round_trip) {
+        round_best = sample;
+    }
+}
+
+// A round whose best sample was queued is skipped, as its offset may be
+// off by much of the extra delay. The first measurements are averaged, each
+// with gain 1/n; after that the gain stays at interval / FLL_TIME_CONSTANT,
+// so the noise of single samples is averaged over about ten minutes.
+void OffsetEstimator::measure(const Sample &best) {
+    if (best.round_trip > 2 * round_trip() + microseconds(50)) return;
+    if (base_at == SyncClock::time_point::min()) {
+        base = best;
+        base_at = best.at;
+        return;
+    }
+    double interval = static_cast<double>((best.at - base_at).count());
+    if (interval <= 0) return;
+    double slope = static_cast<double>((best.offset - base.offset).count()) / interval;
+    ++measurements;
+    double gain = std::max(1.0 / static_cast<double>(measurements),
+                           interval / static_cast<double>(nanoseconds(FLL_TIME_CONSTANT).count()));
+    rate = std::clamp(rate + std::min(gain, 1.0) * (slope - rate), -MAX_DRIFT, MAX_DRIFT);
+    base = best;
+    base_at = best.at;
+}
+
+nanoseconds OffsetEstimator::drifted(SyncClock::duration elapsed) const {
+    return nanoseconds(std::llround(rate * static_cast<double>(elapsed.count())));
+}
+
+nanoseconds OffsetEstimator::filtered(SyncClock::time_point at) const {
+    std::array<Sample, WINDOW> best;
+    std::copy_n(window.begin(), count, best.begin());
+    size_t selected = std::min(count, SELECT);
+    std::partial_sort(best.begin(), best.begin() + static_cast<std::ptrdiff_t>(selected),
+                      best.begin() + static_cast<std::ptrdiff_t>(count),
+                      [](const Sample &a, const Sample &b) { return a.round_trip < b.round_trip; });
+
+    std::array<nanoseconds, SELECT> offsets;
+    for (size_t i = 0; i < selected; ++i) offsets[i] = best[i].offset + drifted(at - best[i].at);
+    std::sort(offsets.begin(), offsets.begin() + static_cast<std::ptrdiff_t>(selected));
+    size_t mid = selected / 2;
+    if (selected % 2 == 1) return offsets[mid];
+    return offsets[mid - 1] + (offsets[mid] - offsets[mid - 1]) / 2;
+}
+
+nanoseconds OffsetEstimator::offset_at(SyncClock::time_point at) const {
+    if (count == 0) return applied;
+    return applied + drifted(at - applied_at);
+}
+
+nanoseconds OffsetEstimator::offset() const {
+    return applied;
+}
+
+SyncClock::time_point OffsetEstimator::reference() const {
+    return applied_at;
+}
+
+double OffsetEstimator::drift() const {
+    return rate;
+}
+
+nanoseconds OffsetEstimator::round_trip() const {
+    nanoseconds best = nanoseconds::max();
+    for (size_t i = 0; i < count; ++i) best = std::min(best, window[i].round_trip);
+    return count == 0 ? nanoseconds(0) : best;
+}
+
+size_t OffsetEstimator::samples() const {
+    return count;
+}
+
+void OffsetEstimator::reset() {
+    count = 0;
+    next = 0;
+    applied = nanoseconds(0);
+    base_at = SyncClock::time_point::min();
+    round_began = SyncClock::time_point::min();
+}
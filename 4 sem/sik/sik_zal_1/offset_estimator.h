@@ -0,0 +1,119 @@
+#ifndef OFFSET_ESTIMATOR_H
+#define OFFSET_ESTIMATOR_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+
+#include "sync_clock.h"
+
+// The OffsetEstimator class turns the offset samples of individual
+// SYNC_START / DELAY_REQUEST exchanges with one source into the offset the
+// node applies.
+//
+// A sample delayed by queueing has a large round-trip time and an offset
+// skewed by up to half of it, so the estimator keeps the last WINDOW samples,
+// selects the SELECT with the smallest round trip and takes the median of
+// their offsets. The applied offset then moves towards that estimate by at
+// most max_slew per sample, so one outlier that slips through cannot jump the
+// clock. Until SELECT samples are in, and whenever the estimate is more than
+// step_threshold away, the offset is stepped instead, so a new source or a
+// real jump is picked up at once.
+//
+// The offset also drifts: CLOCK_MONOTONIC_RAW runs off the host's crystal,
+// typically some ppm away from the source's. A frequency-locked loop
+// estimates that drift from the slope between the best samples of successive
+// rounds (samples less than MIN_INTERVAL apart form a round), skipping rounds
+// whose best round trip is well above the window's. It averages the first
+// measurements and then follows with a time constant of FLL_TIME_CONSTANT.
+// The slope uses raw samples only, never the drift-corrected estimate, so a
+// wrong drift cannot feed back into its own measurement. The offset is then
+// applied as a line: offset_at() carries the last estimate on at the drift
+// rate, so the clock stays synchronized between rounds instead of wandering
+// off until the next one, and older samples are moved along the same line
+// before they are compared with new ones. The drift survives reset(), as it
+// belongs to the local crystal rather than to the source.
+class OffsetEstimator {
+public:
+    static constexpr size_t WINDOW = 16;
+    static constexpr size_t SELECT = 4;
+
+    static constexpr std::chrono::seconds MIN_INTERVAL{4};
+    static constexpr std::chrono::seconds FLL_TIME_CONSTANT{600};
+    static constexpr double MAX_DRIFT = 500e-6;
+
+    // With track_drift false, the drift stays 0 and the offset is a constant
+    // between samples.
+    explicit OffsetEstimator(std::chrono::nanoseconds max_slew = std::chrono::microseconds(500),
+                             std::chrono::nanoseconds step_threshold = std::chrono::milliseconds(128),
+                             bool track_drift = true);
+
+    // Adds the sample of one exchange completed at local time at: its offset
+    // (T2 - T1 + T3 - T4) / 2 and its round trip (T4 - T1) - (T3 - T2).
+    // Returns the offset to apply at that time.
+    std::chrono::nanoseconds add(std::chrono::nanoseconds offset,
+                                 std::chrono::nanoseconds round_trip,
+                                 SyncClock::time_point at);
+
+    // Returns the offset to apply at local time at.
+    std::chrono::nanoseconds offset_at(SyncClock::time_point at) const;
+
+    // Returns the offset applied at reference(), the time of the last sample.
+    std::chrono::nanoseconds offset() const;
+    SyncClock::time_point reference() const;
+
+    // Returns the estimated drift, in nanoseconds of offset per nanosecond.
+    double drift() const;
+
+    // Returns the smallest round trip in the window, the delay of the best
+    // samples the estimate is built from.
+    std::chrono::nanoseconds round_trip() const;
+
+    // Returns the number of samples in the window.
+    size_t samples() const;
+
+    // Forgets all samples, e.g. when the node switches to another source.
+    void reset();
+
+private:
+    struct Sample {
+        std::chrono::nanoseconds offset;
+        std::chrono::nanoseconds round_trip;
+        SyncClock::time_point at;
+    };
+
+    // Returns the median offset of the SELECT lowest round-trip samples,
+    // each carried on to at at the current drift.
+    std::chrono::nanoseconds filtered(SyncClock::time_point at) const;
+
+    // Feeds a sample to the frequency loop, which measures the drift once
+    // the round after the sample's has started.
+    void track(const Sample &sample);
+
+    // Measures the drift from the base sample to a round's best sample.
+    void measure(const Sample &best);
+
+    // Returns the offset change over elapsed at the current drift.
+    std::chrono::nanoseconds drifted(SyncClock::duration elapsed) const;
+
+    std::chrono::nanoseconds max_slew;
+    std::chrono::nanoseconds step_threshold;
+    bool track_drift;
+    std::array<Sample, WINDOW> window{};
+    size_t count = 0;                       // Samples in the window.
+    size_t next = 0;                        // Slot the next sample goes to.
+    std::chrono::nanoseconds applied{0};
+    SyncClock::time_point applied_at{};
+
+    // Frequency loop: the drift, the number of measurements it has taken,
+    // the sample the next one is measured from, and the best sample of the
+    // current round and when the round began.
+    double rate = 0;
+    size_t measurements = 0;
+    Sample base{};
+    Sample round_best{};
+    SyncClock::time_point base_at = SyncClock::time_point::min();
+    SyncClock::time_point round_began = SyncClock::time_point::min();
+};
+
+#endif // OFFSET_ESTIMATOR_H
@@ -0,0 +1,77 @@
+#include "peer_table.h"
+#include <algorithm>
+
+// A known peer changes precision only when it restarts with a different
+// version, so moving it between the per-precision lists may cost a linear scan.
+bool PeerTable::add(const Endpoint &peer, Precision precision, SyncClock::time_point now) {
+    auto [it, inserted] = index.try_emplace(peer, states.size());
+    if (!inserted) {
+        PeerState &state = states[it->second];
+        if (state.precision != precision) {
+            auto &from = by_precision[static_cast<size_t>(state.precision)];
+            from.erase(std::find(from.begin(), from.end(), it->first));
+            by_precision[static_cast<size_t>(precision)].push_back(state.address);
+            state.precision = precision;
+        }
+        return false;
+    }
+    PeerState state;
+    state.address = peer;
+    state.last_heard = now;
+    state.precision = precision;
+    order.push_back(state.address);
+    by_precision[static_cast<size_t>(precision)].push_back(state.address);
+    states.push_back(state);
+    return true;
+}
+
+// The per-precision lists are scanned linearly; removal only happens in a
+// bounded membership view, where they are short.
+bool PeerTable::remove(const Endpoint &peer) {
+    auto it = index.find(peer);
+    if (it == index.end()) return false;
+    size_t pos = it->second;
+    auto &list = by_precision[static_cast<size_t>(states[pos].precision)];
+    list.erase(std::find(list.begin(), list.end(), peer));
+    index.erase(it);
+
+    size_t last = states.size() - 1;
+    if (pos != last) {
+        states[pos] = states[last];
+        order[pos] = order[last];
+        index[order[pos]] = pos;
+    }
+    states.pop_back();
+    order.pop_back();
+    return true;
+}
+
+bool PeerTable::contains(const Endpoint &peer) const {
+    return index.find(peer) != index.end();
+}
+
+PeerState *PeerTable::find(const Endpoint &peer) {
+    auto it = index.find(peer);
+    return it == index.end() ? nullptr : &states[it->second];
+}
+
+const PeerState *PeerTable::find(const Endpoint &peer) const {
+    auto it = index.find(peer);
+    return it == index.end() ? nullptr : &states[it->second];
+}
+
+const std::vector<Endpoint> &PeerTable::addresses() const {
+    return order;
+}
+
+const std::vector<Endpoint> &PeerTable::addresses(Precision precision) const {
+    return by_precision[static_cast<size_t>(precision)];
+}
+
+const PeerState &PeerTable::operator[](size_t i) const {
+    return states[i];
+}
+
+size_t PeerTable::size() const {
+    return states.size();
+}
@@ -0,0 +1,73 @@
+#ifndef PEER_TABLE_H
+#define PEER_TABLE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <unordered_map>
+#include <vector>
+
+#include "message.h"
+#include "sync_clock.h"
+#include "endpoint.h"
+
+// The PeerState structure is what the node remembers about one known peer.
+struct PeerState {
+    Endpoint address;                                        // Where to send to the peer.
+    SyncClock::time_point last_heard{};                      // Last datagram received from it.
+    int synchronization = 255;                               // Level it last advertised.
+    Precision precision = Precision::MILLISECONDS;           // Unit of timestamps sent to it.
+    bool gossip = false;                                     // Advertised CAPABILITY_GOSSIP.
+
+    // Used when the node limits its fan-out (see SyncNode).
+    SyncClock::time_point sync_heard = SyncClock::time_point::min();   // Last SYNC_START from it.
+    SyncClock::time_point offered = SyncClock::time_point::min();      // Last round it got our SYNC_START.
+    SyncClock::time_point last_request = SyncClock::time_point::min(); // Last DELAY_REQUEST from it.
+    SyncClock::time_point declined = SyncClock::time_point::min();     // Last offer it ignored.
+    std::chrono::nanoseconds latency{0};        // SYNC_START to DELAY_REQUEST; 0 if not measured.
+};
+
+// The PeerTable class stores the known peers keyed by their Endpoint.
+// Lookup is a single hash probe on the binary address, with no string
+// conversion, for IPv4 and IPv6 alike. Peers are kept in insertion order, so broadcasts can iterate a
+// contiguous array of addresses that stays stable while peers are added.
+// Adding an already known peer only updates its precision. Removal moves the
+// last peer into the freed slot.
+class PeerTable {
+public:
+    // Adds the peer if it is not known yet, otherwise sets its precision to
+    // what it advertised last. now is recorded as the time it was last heard.
+    // Returns true if it was inserted.
+    bool add(const Endpoint &peer, Precision precision, SyncClock::time_point now);
+
+    // Forgets the peer. The last peer takes its place in insertion order.
+    // Returns false if it was not known.
+    bool remove(const Endpoint &peer);
+
+    // Returns true if the peer is known.
+    bool contains(const Endpoint &peer) const;
+
+    // Returns the peer's state, or nullptr if it is not known.
+    PeerState *find(const Endpoint &peer);
+    const PeerState *find(const Endpoint &peer) const;
+
+    // Returns all peer addresses in insertion order, ready for send_to_all.
+    const std::vector<Endpoint> &addresses() const;
+
+    // Returns the addresses of the peers that take the given precision, in
+    // insertion order, so each group can get its own SYNC_START template.
+    const std::vector<Endpoint> &addresses(Precision precision) const;
+
+    // Returns the state of the i-th peer in insertion order.
+    const PeerState &operator[](size_t index) const;
+
+    size_t size() const;
+
+private:
+    std::vector<Endpoint> order;                 // Parallel to states.
+    std::vector<Endpoint> by_precision[2];       // Indexed by Precision.
+    std::vector<PeerState> states;
+    std::unordered_map<Endpoint, size_t, Endpoint::Hash> index;    // -> position.
+};
+
+#endif // PEER_TABLE_H
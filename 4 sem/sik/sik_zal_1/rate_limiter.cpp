@@ -0,0 +1,53 @@
+#include "rate_limiter.h"
+#include <algorithm>
+#include <chrono>
+
+using namespace std;
+using namespace std::chrono;
+
+bool TokenBucket::take(double rate, double burst, SyncClock::time_point now) {
+    if (last == SyncClock::time_point::min()) {
+        tokens = burst;
+    } else if (now > last) {
+        tokens = min(burst, tokens + duration<double>(now - last).count() * rate);
+    }
+    last = max(last, now);
+    if (tokens < 1) return false;
+    tokens -= 1;
+    return true;
+}
+
+RateLimiter::RateLimiter(double peer_rate, double peer_burst, double all_rate, size_t max_senders)
+    : rate(peer_rate),
+      burst(max(peer_burst, 1.0)),
+      total_rate(all_rate),
+      capacity(max_senders) {
+    buckets.reserve(capacity);
+}
+
+bool RateLimiter::allow(const Endpoint &sender, SyncClock::time_point now) {
+    if (rate > 0) {
+        auto it = buckets.find(sender);
+        if (it == buckets.end() && buckets.size() >= capacity) {
+            expire(now);
+        }
+        TokenBucket *bucket = &overflow;
+        if (it != buckets.end()) {
+            bucket = &it->second;
+        } else if (buckets.size() < capacity) {
+            bucket = &buckets[sender];
+        }
+        if (!bucket->take(rate, burst, now)) return false;
+    }
+    // The total bucket holds a second's worth of requests.
+    return total_rate <= 0 || total.take(total_rate, total_rate, now);
+}
+
+// A sweep walks the whole table, so it runs at most once per refill time:
+// buckets emptied since the last sweep cannot have refilled before then.
+void RateLimiter::expire(SyncClock::time_point now) {
+    auto refill = duration_cast<SyncClock::duration>(duration<double>(burst / rate));
+    if (last_expiry != SyncClock::time_point::min() && now - last_expiry < refill) return;
+    last_expiry = now;
+    erase_if(buckets, [&](const auto &entry) { return now - entry.second.last >= refill; });
+}
@@ -0,0 +1,54 @@
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include <cstddef>
+#include <unordered_map>
+
+#include "endpoint.h"
+#include "sync_clock.h"
+
+// A token bucket: it holds up to burst tokens and gains rate tokens a
+// second; each admitted event takes one.
+struct TokenBucket {
+    double tokens = 0;
+    SyncClock::time_point last = SyncClock::time_point::min();
+
+    // Refills the bucket up to now and takes a token if there is one. A
+    // bucket never used before starts full.
+    bool take(double rate, double burst, SyncClock::time_point now);
+};
+
+// The RateLimiter class admits requests per sender endpoint, each sender with
+// a token bucket of its own, and all of them together within a total rate.
+//
+// Buckets are kept for at most capacity senders, so a flood from spoofed
+// addresses cannot grow the table without bound. A bucket that has refilled
+// is the same as none and is dropped when the table is full; while it is
+// still full, new senders share one overflow bucket.
+class RateLimiter {
+public:
+    // A rate of 0 disables the per-sender limit, a total_rate of 0 the
+    // total one.
+    RateLimiter(double rate, double burst, double total_rate = 0, size_t capacity = 4096);
+
+    // Returns true if a request from sender arriving at now may be served.
+    bool allow(const Endpoint &sender, SyncClock::time_point now);
+
+    // Returns the number of senders with a bucket of their own.
+    size_t senders() const { return buckets.size(); }
+
+private:
+    // Drops the buckets that have refilled since their last request.
+    void expire(SyncClock::time_point now);
+
+    double rate;
+    double burst;
+    double total_rate;
+    size_t capacity;
+    std::unordered_map<Endpoint, TokenBucket, Endpoint::Hash> buckets;
+    TokenBucket overflow;
+    TokenBucket total;
+    SyncClock::time_point last_expiry = SyncClock::time_point::min();
+};
+
+#endif // RATE_LIMITER_H
@@ -1,6 +1,7 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <optional>
 #include <cstdlib>
 #include <cstdint>
 #include <cerrno>
@@ -12,6 +13,7 @@
 
 #include "err.h"
 #include "message.h"
+#include "endpoint.h"
 
 int main(int argc, char *argv[]) {
     // Ensure correct usage: program expects exactly three arguments.
@@ -41,22 +43,22 @@ int main(int argc, char *argv[]) {
     }
     int sync_level = static_cast<int>(sync_val);
 
-    // Create a UDP socket for communication.
-    int sock = ::socket(AF_INET, SOCK_DGRAM, 0);
-    if (sock < 0) {
-        syserr("socket");
-    }
-
-    // Prepare the destination sockaddr_in structure.
-    struct sockaddr_in dest{};
-    dest.sin_family = AF_INET;
-    dest.sin_port   = htons(port);
-    if (inet_pton(AF_INET, ip, &dest.sin_addr) <= 0) {
+    // Parse the destination, IPv4 or IPv6.
+    std::optional<Endpoint> peer = Endpoint::parse(ip, port);
+    if (!peer) {
         std::cerr << "Invalid IP address: " << ip << "\n";
-        ::close(sock);
         return EXIT_FAILURE;
     }
 
+    // Create a UDP socket of the destination's family.
+    int family = peer->is_v4() ? AF_INET : AF_INET6;
+    int sock = ::socket(family, SOCK_DGRAM, 0);
+    if (sock < 0) {
+        syserr("socket");
+    }
+    sockaddr_storage dest{};
+    socklen_t dest_len = peer->to_sockaddr(family, dest);
+
     // Build a LEADER message with the specified synchronization level.
     Message msg = make_LEADER(sync_level);
     msg.refresh_count();  // Ensure count field matches nodes vector size.
@@ -71,14 +73,14 @@ int main(int argc, char *argv[]) {
         buf.size(),
         0,
         reinterpret_cast<const struct sockaddr*>(&dest),
-        sizeof(dest)
+        dest_len
     );
     if (sent_bytes < 0) {
         syserr("sendto");
     }
 
     // Report success to stdout.
-    std::cout << "Sent LEADER to " << ip << ":" << port
+    std::cout << "Sent LEADER to " << peer->to_string()
               << " (" << sent_bytes << " bytes)\n";
 
     // Close the socket before exiting.
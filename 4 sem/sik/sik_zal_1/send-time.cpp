@@ -1,6 +1,7 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <optional>
 #include <cstdlib>
 #include <cstdint>
 #include <cerrno>
@@ -14,20 +15,29 @@
 
 #include "err.h"
 #include "message.h"
+#include "endpoint.h"
 
 int main(int argc, char *argv[]) {
+    // An optional leading -n asks for nanosecond readings and accuracy.
+    uint64_t capabilities = 0;
+    int first = 1;
+    if (argc > 1 && std::string(argv[1]) == "-n") {
+        capabilities = CAPABILITY_NANOSECONDS;
+        first = 2;
+    }
+
     // This program expects pairs of IP addresses and ports as command-line arguments.
-    if (argc < 3 || (argc % 2) == 0) {
+    if (argc - first < 2 || ((argc - first) % 2) != 0) {
         std::cerr << "Usage: " << argv[0]
-                  << " <ip1> <port1> [<ip2> <port2> ...]" << std::endl;
+                  << " [-n] <ip1> <port1> [<ip2> <port2> ...]" << std::endl;
         return EXIT_FAILURE;
     }
 
-    // We will store each peer's sockaddr_in structure in this vector.
-    std::vector<sockaddr_in> peers;
+    // We will store each peer's endpoint in this vector.
+    std::vector<Endpoint> peers;
 
     // Parse the command-line arguments into the peers vector.
-    for (int i = 1; i < argc; i += 2) {
+    for (int i = first; i < argc; i += 2) {
         const char *ip = argv[i];
         const char *port_str = argv[i + 1];
         char *endptr = nullptr;
@@ -41,41 +51,48 @@ int main(int argc, char *argv[]) {
         }
         uint16_t port = static_cast<uint16_t>(p);
 
-        // Initialize a sockaddr_in structure for this peer.
-        sockaddr_in dest{};
-        dest.sin_family = AF_INET;
-        dest.sin_port   = htons(port);
-
-        // Convert the IP address string to a binary representation.
-        if (inet_pton(AF_INET, ip, &dest.sin_addr) <= 0) {
+        // Convert the IPv4 or IPv6 address string to an endpoint.
+        std::optional<Endpoint> dest = Endpoint::parse(ip, port);
+        if (!dest) {
             std::cerr << "Invalid IP: " << ip << std::endl;
             return EXIT_FAILURE;
         }
 
-        // Add the initialized structure to the peers vector.
-        peers.push_back(dest);
+        // Add the endpoint to the peers vector.
+        peers.push_back(*dest);
     }
 
-    // Create a non-blocking UDP socket for sending and receiving.
-    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    // Create a non-blocking UDP socket for sending and receiving. If any
+    // peer is IPv6, a dual-stack IPv6 socket reaches the IPv4 ones as well.
+    int family = AF_INET;
+    for (const auto &dest : peers) {
+        if (!dest.is_v4()) family = AF_INET6;
+    }
+    int sock = socket(family, SOCK_DGRAM, 0);
     if (sock < 0) {
         syserr("socket");
     }
+    if (family == AF_INET6) {
+        int off = 0;
+        setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+    }
     int flags = fcntl(sock, F_GETFL, 0);
     fcntl(sock, F_SETFL, flags | O_NONBLOCK);
 
     // Send a GET_TIME request message to each peer.
     for (const auto &dest : peers) {
-        Message req = make_GET_TIME();
+        Message req = make_GET_TIME(capabilities);
         req.refresh_count();  // Ensure the node count is up to date.
         auto buf = serialize(req);
+        sockaddr_storage name{};
+        socklen_t name_len = dest.to_sockaddr(family, name);
 
         // Transmit the serialized message via UDP.
         if (sendto(sock,
                    reinterpret_cast<const char*>(buf.data()), buf.size(),
                    0,
-                   reinterpret_cast<const sockaddr*>(&dest),
-                   sizeof(dest)) < 0) {
+                   reinterpret_cast<const sockaddr*>(&name),
+                   name_len) < 0) {
             syserr("sendto GET_TIME");
         }
     }
@@ -91,7 +108,7 @@ int main(int argc, char *argv[]) {
 
     // Loop until the timeout expires, collecting incoming messages.
     while (std::chrono::steady_clock::now() - start < timeout) {
-        sockaddr_in src_addr{};
+        sockaddr_storage src_addr{};
         socklen_t addrlen = sizeof(src_addr);
 
         // Attempt to receive a UDP packet.
@@ -126,10 +143,9 @@ int main(int argc, char *argv[]) {
         }
 
         // Match the source address to our list of peers.
+        std::optional<Endpoint> src = Endpoint::from_sockaddr(src_addr);
         for (size_t i = 0; i < peers.size(); ++i) {
-            if (!received[i] &&
-                peers[i].sin_addr.s_addr == src_addr.sin_addr.s_addr &&
-                peers[i].sin_port == src_addr.sin_port) {
+            if (!received[i] && src && peers[i] == *src) {
                 // Record the received response for this peer.
                 received[i]   = true;
                 responses[i] = resp;
@@ -141,12 +157,19 @@ int main(int argc, char *argv[]) {
     // After timeout, print all successfully received TIME responses.
     for (size_t i = 0; i < peers.size(); ++i) {
         if (received[i]) {
-            char ipbuf[INET_ADDRSTRLEN];
-            inet_ntop(AF_INET, &peers[i].sin_addr, ipbuf, sizeof(ipbuf));
-            uint16_t port = ntohs(peers[i].sin_port);
-            std::cout << "TIME from " << ipbuf << ":" << port
-                      << " | sync level=" << static_cast<int>(responses[i].synchronized)
-                      << " | timestamp=" << responses[i].timestamp << " ms" << std::endl;
+            std::cout << "TIME from " << peers[i].to_string()
+                      << " | sync level=" << static_cast<int>(responses[i].synchronized);
+            // Nodes that predate the nanosecond mode answer in milliseconds.
+            const Message &r = responses[i];
+            if (r.nodes.size() == 1 && r.nodes[0].peer_address_length == PRECISION_RECORD_LENGTH) {
+                uint64_t accuracy = decode_timestamp(r.nodes[0].peer_address.data());
+                std::cout << " | timestamp=" << r.timestamp << " ns | accuracy=";
+                if (accuracy == UNKNOWN_ACCURACY) std::cout << "unknown";
+                else std::cout << accuracy << " ns";
+                std::cout << std::endl;
+            } else {
+                std::cout << " | timestamp=" << r.timestamp << " ms" << std::endl;
+            }
         }
     }
 
@@ -0,0 +1,471 @@
+// Discrete-event simulation of a peer-time-sync network in one process.
+//
+// Usage: ./sim-network [nodes] [topology] [seconds] [seed] [loss] [fanout] [family] [failover]
+//   Runs `nodes` SyncNodes (1000 by default) on a virtual clock. Node i joins
+//   at i * 100 us and sends HELLO to an earlier node: its parent in a 4-ary
+//   tree (topology "tree", the default), a uniformly random one ("random"),
+//   or its predecessor ("chain"). One second after the last join, node 0 is
+//   made leader, and the network runs for `seconds` (60) of virtual time.
+//
+//   Every directed link has its own base latency (100-600 us, fixed per
+//   link), exponential jitter (mean 50 us) and independent loss (`loss`,
+//   0.01 by default). A non-zero `fanout` limits the children every node
+//   serves, as peer-time-sync -f does. `family` gives the nodes IPv4
+//   addresses ("v4", the default), IPv6 ones ("v6"), or alternates ("mixed").
+//   With `failover` 1 every node is electable, as with peer-time-sync -e,
+//   and the leader fails halfway through the run: its port closes and it
+//   stops sending.
+//
+//   Reported: how long after LEADER every node in the leader's partition is
+//   synchronized (a node whose HELLO or HELLO_REPLY is lost knows nobody and
+//   stays cut off, as the protocol never retries it), sync levels and clock
+//   error against the leader at the end, the size of the membership views,
+//   how many nodes still keep a failed leader as a neighbour,
+//   the packets per second the leader and the busiest node send and receive
+//   over the second half of the run, messages per type, and
+//   after a failover: when the new leader was elected, when its partition
+//   was synchronized again, and how far its clock was from the failed
+//   leader's, which keeps running in the simulation. Also
+//   simulator throughput in events per second of wall-clock time, which makes
+//   the tool usable as a regression benchmark.
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <queue>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <arpa/inet.h>
+
+#include "err.h"
+#include "message.h"
+#include "sync_node.h"
+
+using namespace std;
+using namespace chrono;
+
+constexpr nanoseconds JOIN_INTERVAL = microseconds(100);
+constexpr nanoseconds BASE_LATENCY  = microseconds(100);
+constexpr nanoseconds LATENCY_SPREAD = microseconds(500);
+constexpr double      JITTER_MEAN_NS = 50e3;
+constexpr uint16_t    PORT = 5000;
+
+static string address_family = "v4";
+
+// Address of node i: 10.x.y.z or fd00::x:yz, all on the same port.
+static Endpoint node_address(size_t i) {
+    bool v6 = address_family == "v6" || (address_family == "mixed" && i % 2 == 1);
+    uint8_t bytes[16] = {0xfd};
+    auto id = static_cast<uint32_t>(i);
+    uint8_t *tail = v6 ? bytes + 12 : bytes;
+    tail[0] = v6 ? 0 : 10;
+    tail[1] = static_cast<uint8_t>(id >> 16);
+    tail[2] = static_cast<uint8_t>(id >> 8);
+    tail[3] = static_cast<uint8_t>(id);
+    return *Endpoint::from_bytes(bytes, v6 ? 16 : 4, htons(PORT));
+}
+
+class Simulator;
+
+// The SimClock class is one node's view of virtual time.
+class SimClock : public SyncNode::Clock {
+public:
+    explicit SimClock(const SyncClock::time_point &sim_now) : now_ref(sim_now) {}
+
+    SyncClock::time_point now() override {
+        return now_ref;
+    }
+
+private:
+    const SyncClock::time_point &now_ref;
+};
+
+// The SimTransport class hands a node's datagrams to the simulator.
+class SimTransport : public SyncNode::Transport {
+public:
+    SimTransport(Simulator &simulator, size_t node) : sim(simulator), from(node) {}
+
+    bool send(const uint8_t *data, size_t len, const Endpoint &dest) override;
+
+    size_t send_to_all(const vector<Endpoint> &destinations,
+                       const uint8_t *data, size_t len,
+                       const function<void()> &before_batch) override {
+        for (size_t i = 0; i < destinations.size(); ++i) {
+            if (i % IO_BATCH == 0 && before_batch) before_batch();
+            send(data, len, destinations[i]);
+        }
+        return destinations.size();
+    }
+
+private:
+    Simulator &sim;
+    size_t from;
+};
+
+struct SimNode {
+    SimClock clock;
+    SimTransport transport;
+    SyncNode node;
+    SyncClock::time_point timer = SyncClock::time_point::max();   // Scheduled on_timer().
+
+    SimNode(Simulator &sim, const SyncClock::time_point &now, size_t index,
+            optional<Endpoint> contact, size_t fanout, bool electable);
+};
+
+class Simulator {
+public:
+    Simulator(size_t node_count, string topology, double loss_rate, size_t fanout, bool failover,
+              uint64_t seed)
+        : count(node_count), shape(std::move(topology)), loss(loss_rate), max_children(fanout),
+          electable(failover), rng(seed), traffic(node_count, 0) {
+        nodes_by_key.reserve(count);
+        for (size_t i = 0; i < count; ++i) nodes_by_key[node_address(i)] = i;
+        nodes.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            push(Event{SyncClock::time_point(JOIN_INTERVAL * static_cast<int64_t>(i)),
+                       0, Event::JOIN, i, 0, {}, {}});
+        }
+    }
+
+    // Runs until the given virtual time, sampling the network every second
+    // once the leader is appointed. With failover the leader fails halfway.
+    void run(SyncClock::time_point leader_at, SyncClock::time_point end) {
+        leader_time = leader_at;
+        measure_from = leader_at + (end - leader_at) / 2;
+        measure_seconds = duration<double>(end - measure_from).count();
+        if (electable) fail_time = measure_from;
+        Message leader_msg = make_LEADER(0);
+        push(Event{leader_at, 0, Event::DELIVER, 0, count, serialize(leader_msg), leader_at});
+        for (auto t = leader_at; t <= end; t += seconds(1)) {
+            push(Event{t, 0, Event::SAMPLE, 0, 0, {}, {}});
+        }
+        while (!events.empty() && events.top().time <= end) {
+            Event ev = std::move(const_cast<Event &>(events.top()));
+            events.pop();
+            now = ev.time;
+            ++processed;
+            handle(ev);
+        }
+    }
+
+    // Queues a datagram from node `from` to dest, applying the link model.
+    void transmit(size_t from, const uint8_t *data, size_t len, const Endpoint &dest) {
+        ++sent[data[0]];
+        if (now >= measure_from) ++traffic[from];
+        auto it = nodes_by_key.find(dest);
+        if (it == nodes_by_key.end() || failed(it->second) || bernoulli_distribution(loss)(rng)) {
+            ++lost;
+            return;
+        }
+        size_t to = it->second;
+        if (now >= measure_from) ++traffic[to];
+        auto at = now + link_latency(from, to);
+        push(Event{at, 0, Event::DELIVER, to, from, vector<uint8_t>(data, data + len), at});
+    }
+
+    void report(double wall_seconds) const {
+        cout << "Nodes " << count << " (" << address_family << "), topology " << shape << ", loss " << loss
+             << ", fanout " << (max_children == 0 ? string("unlimited") : to_string(max_children)) << "\n";
+        cout << final_synced << " of " << count << " nodes synchronized, "
+             << final_reachable << " in the leader's partition\n";
+        if (all_synced_after < 0) {
+            cout << "leader's partition not fully synchronized\n";
+        } else {
+            cout << "leader's partition synchronized " << all_synced_after << " s after LEADER\n";
+        }
+        if (electable) {
+            cout << fixed << setprecision(1);
+            if (elected_after < 0) {
+                cout << "failover: no leader elected after the leader failed\n";
+            } else {
+                cout << "failover: node " << elected << " elected " << elected_after
+                     << " s after the leader failed, " << leaders_elected << " elected in all; ";
+                if (recovered_after < 0) cout << "partition not synchronized again\n";
+                else cout << "partition synchronized after " << recovered_after << " s\n";
+                cout << "clock step at failover: " << clock_step / 1e3 << " us\n";
+            }
+        }
+        cout << "sync level depth: max " << final_max_level << ", levels";
+        for (auto [lvl, n] : final_levels) cout << " " << lvl << ":" << n;
+        cout << "\n";
+        cout << fixed << setprecision(1)
+             << "clock error vs leader: median " << final_error_p50 / 1e3
+             << " us, p99 " << final_error_p99 / 1e3
+             << " us, max " << final_error_max / 1e3 << " us\n";
+
+        size_t active_sum = 0, active_max = 0, passive_sum = 0, stale = 0;
+        for (const auto &n : nodes) {
+            if (!n) continue;
+            if (failed(0) && n->node.view().active().contains(node_address(0))) ++stale;
+            active_sum += n->node.view().active().size();
+            active_max = max(active_max, n->node.view().active().size());
+            passive_sum += n->node.view().passive().size();
+        }
+        size_t busiest = static_cast<size_t>(max_element(traffic.begin(), traffic.end()) - traffic.begin());
+        cout << "packets/s: leader " << static_cast<double>(traffic[leader]) / measure_seconds
+             << " (" << nodes[leader]->node.children() << " children), busiest node "
+             << static_cast<double>(traffic[busiest]) / measure_seconds
+             << " (" << (nodes[busiest] ? nodes[busiest]->node.children() : 0) << " children)\n";
+        cout << "neighbours per node: mean " << static_cast<double>(active_sum) / static_cast<double>(count)
+             << ", max " << active_max << "; passive view mean "
+             << static_cast<double>(passive_sum) / static_cast<double>(count);
+        if (failed(0)) cout << "; failed leader still a neighbour of " << stale;
+        cout << "\n";
+
+        static const map<uint8_t, string> names = {
+            {1, "HELLO"}, {2, "HELLO_REPLY"}, {3, "CONNECT"}, {4, "ACK_CONNECT"},
+            {DISCONNECT, "DISCONNECT"}, {SHUFFLE, "SHUFFLE"}, {SHUFFLE_REPLY, "SHUFFLE_REPLY"},
+            {FORWARD_JOIN, "FORWARD_JOIN"}, {ELECTION, "ELECTION"},
+            {11, "SYNC_START"}, {12, "DELAY_REQUEST"}, {13, "DELAY_RESPONSE"},
+            {21, "LEADER"}, {31, "GET_TIME"}, {32, "TIME"}};
+        uint64_t total = 0;
+        for (auto [type, name] : names) {
+            if (sent[type] == 0) continue;
+            cout << "  " << left << setw(16) << name << right << setw(12) << sent[type] << "\n";
+            total += sent[type];
+        }
+        cout << "  " << left << setw(16) << "total" << right << setw(12) << total
+             << "  (" << lost << " lost)\n";
+        cout << setprecision(2) << "simulated " << processed << " events in " << wall_seconds
+             << " s, " << setprecision(0) << static_cast<double>(processed) / wall_seconds
+             << " events/s\n";
+    }
+
+private:
+    struct Event {
+        enum Kind { JOIN, DELIVER, TIMER, SAMPLE };
+        SyncClock::time_point time;
+        uint64_t seq;                   // Keeps equal times in FIFO order.
+        Kind kind;
+        size_t node;
+        size_t from;                    // Sender; == count for the controller.
+        vector<uint8_t> payload;
+        SyncClock::time_point arrived;  // When the datagram reached the socket.
+
+        bool operator>(const Event &other) const {
+            return time != other.time ? time > other.time : seq > other.seq;
+        }
+    };
+
+    void push(Event ev) {
+        ev.seq = next_seq++;
+        events.push(std::move(ev));
+    }
+
+    // Every directed link gets a fixed base latency derived from its ends;
+    // jitter is drawn per datagram.
+    nanoseconds link_latency(size_t from, size_t to) {
+        uint64_t h = (static_cast<uint64_t>(from) * 0x9E3779B97F4A7C15ull) ^
+                     (static_cast<uint64_t>(to) * 0xC2B2AE3D27D4EB4Full);
+        h ^= h >> 29;
+        auto spread = static_cast<uint64_t>(LATENCY_SPREAD.count());
+        auto base = BASE_LATENCY + nanoseconds(static_cast<nanoseconds::rep>(h % spread));
+        double jitter = exponential_distribution<double>(1.0 / JITTER_MEAN_NS)(rng);
+        return base + nanoseconds(static_cast<nanoseconds::rep>(jitter));
+    }
+
+    optional<Endpoint> contact_of(size_t i) {
+        if (i == 0) return nullopt;
+        size_t parent;
+        if (shape == "random") {
+            parent = uniform_int_distribution<size_t>(0, i - 1)(rng);
+        } else if (shape == "chain") {
+            parent = i - 1;
+        } else {
+            parent = (i - 1) / 4;
+        }
+        return node_address(parent);
+    }
+
+    void reschedule(size_t i) {
+        SimNode &n = *nodes[i];
+        auto due = n.node.next_timer();
+        if (due == n.timer) return;
+        n.timer = due;
+        if (due != SyncClock::time_point::max()) {
+            push(Event{max(due, now), 0, Event::TIMER, i, 0, {}, {}});
+        }
+    }
+
+    // Returns true if node i has failed: it neither sends nor receives.
+    bool failed(size_t i) const {
+        return i == 0 && now >= fail_time;
+    }
+
+    void handle(Event &ev) {
+        if (ev.kind == Event::SAMPLE) {
+            sample();
+            return;
+        }
+        if (ev.kind == Event::JOIN) {
+            nodes[ev.node] = make_unique<SimNode>(*this, now, ev.node, contact_of(ev.node),
+                                                  max_children, electable);
+            nodes[ev.node]->node.start();
+            reschedule(ev.node);
+            return;
+        }
+        if (!nodes[ev.node] || failed(ev.node)) return;     // Port closed.
+        SimNode &n = *nodes[ev.node];
+        bool was_leader = n.node.is_leader();
+        if (ev.kind == Event::TIMER) {
+            if (ev.time != n.timer && n.node.next_timer() > now) return;   // Stale.
+            n.timer = SyncClock::time_point::max();
+            if (n.node.next_timer() <= now) n.node.on_timer();
+        } else {
+            Endpoint sender = ev.from == count ? controller : node_address(ev.from);
+            n.node.on_datagram(ev.payload.data(), ev.payload.size(), sender, ev.arrived);
+        }
+        if (!was_leader && n.node.is_leader() && now >= fail_time) {
+            if (leaders_elected++ == 0) {
+                elected = ev.node;
+                elected_after = duration<double>(now - fail_time).count();
+            }
+        }
+        reschedule(ev.node);
+    }
+
+    // Returns which nodes the leader can reach over links both ends know
+    // about; SYNC_START is only accepted from a known peer.
+    vector<bool> leader_partition() const {
+        vector<bool> seen(count, false);
+        vector<size_t> stack{leader};
+        seen[leader] = true;
+        while (!stack.empty()) {
+            size_t i = stack.back();
+            stack.pop_back();
+            for (const Endpoint &peer : nodes[i]->node.peer_table().addresses()) {
+                size_t j = nodes_by_key.at(peer);
+                if (seen[j] || failed(j) || !nodes[j]->node.peer_table().contains(node_address(i))) continue;
+                seen[j] = true;
+                stack.push_back(j);
+            }
+        }
+        return seen;
+    }
+
+    // Records sync levels and clock errors against the leader. After a
+    // failover that is the elected leader, once it is the only one.
+    void sample() {
+        if (now >= fail_time) {
+            if (leaders_elected == 0) return;
+            size_t leaders = 0;
+            for (size_t i = 1; i < count; ++i) leaders += nodes[i]->node.is_leader();
+            if (leaders != 1 || !nodes[elected]->node.is_leader()) return;
+            leader = elected;
+        }
+        if (!nodes[leader]->node.is_leader()) return;
+        nanoseconds leader_reading = nodes[leader]->node.reading();
+        size_t synced = 0, synced_reachable = 0;
+        int max_level = 0;
+        vector<bool> reachable = leader_partition();
+        map<int, size_t> levels;
+        vector<double> errors;
+        for (auto &n : nodes) {
+            if (failed(static_cast<size_t>(&n - nodes.data()))) continue;
+            int lvl = n->node.synchronization();
+            ++levels[lvl];
+            if (lvl >= 254) continue;
+            ++synced;
+            if (reachable[static_cast<size_t>(&n - nodes.data())]) ++synced_reachable;
+            max_level = max(max_level, lvl);
+            errors.push_back(fabs(static_cast<double>((n->node.reading() - leader_reading).count())));
+        }
+        size_t partition = static_cast<size_t>(count_if(reachable.begin(), reachable.end(),
+                                                        [](bool r) { return r; }));
+        if (synced_reachable == partition && all_synced_after < 0) {
+            all_synced_after = duration<double>(now - leader_time).count();
+        }
+        if (leader != 0 && synced_reachable == partition && recovered_after < 0) {
+            recovered_after = duration<double>(now - fail_time).count();
+            clock_step = fabs(static_cast<double>((leader_reading - nodes[0]->node.reading()).count()));
+        }
+        sort(errors.begin(), errors.end());
+        final_levels = levels;
+        final_synced = synced;
+        final_reachable = partition;
+        final_max_level = max_level;
+        if (!errors.empty()) {
+            final_error_p50 = errors[errors.size() / 2];
+            final_error_p99 = errors[static_cast<size_t>(0.99 * static_cast<double>(errors.size() - 1))];
+            final_error_max = errors.back();
+        }
+    }
+
+    size_t count;
+    string shape;
+    double loss;
+    size_t max_children;
+    bool electable;
+    mt19937_64 rng;
+    vector<unique_ptr<SimNode>> nodes;
+    unordered_map<Endpoint, size_t, Endpoint::Hash> nodes_by_key;
+    priority_queue<Event, vector<Event>, greater<Event>> events;
+    uint64_t next_seq = 0;
+    SyncClock::time_point now{};
+    SyncClock::time_point leader_time{};
+    SyncClock::time_point fail_time = SyncClock::time_point::max();
+    size_t leader = 0;                  // The leader being measured against.
+    const Endpoint controller = node_address(0x00FFFFFF);
+
+    uint64_t processed = 0;
+    uint64_t sent[256] = {};
+    uint64_t lost = 0;
+    vector<uint64_t> traffic;           // Packets each node sent or got, from measure_from.
+    SyncClock::time_point measure_from = SyncClock::time_point::max();
+    double measure_seconds = 0;
+    double all_synced_after = -1;
+    size_t elected = 0, leaders_elected = 0;
+    double elected_after = -1, recovered_after = -1, clock_step = 0;
+    map<int, size_t> final_levels;
+    int final_max_level = 0;
+    size_t final_synced = 0, final_reachable = 0;
+    double final_error_p50 = 0, final_error_p99 = 0, final_error_max = 0;
+};
+
+bool SimTransport::send(const uint8_t *data, size_t len, const Endpoint &dest) {
+    sim.transmit(from, data, len, dest);
+    return true;
+}
+
+SimNode::SimNode(Simulator &sim, const SyncClock::time_point &now, size_t index,
+                 optional<Endpoint> contact, size_t fanout, bool electable)
+    : clock(now),
+      transport(sim, index),
+      node(transport, clock, node_address(index), contact, fanout, electable) {}
+
+int main(int argc, char *argv[]) {
+    size_t nodes    = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000;
+    string topology = argc > 2 ? argv[2] : "tree";
+    double seconds_ = argc > 3 ? strtod(argv[3], nullptr) : 60;
+    uint64_t seed   = argc > 4 ? strtoull(argv[4], nullptr, 10) : 1;
+    double loss     = argc > 5 ? strtod(argv[5], nullptr) : 0.01;
+    size_t fanout   = argc > 6 ? strtoul(argv[6], nullptr, 10) : 0;
+    address_family  = argc > 7 ? argv[7] : "v4";
+    bool failover   = argc > 8 && strtoul(argv[8], nullptr, 10) != 0;
+    if (nodes < 2 || nodes >= 0x00FFFFFF || seconds_ <= 0 || loss < 0 || loss >= 1 ||
+        (topology != "tree" && topology != "random" && topology != "chain") ||
+        (address_family != "v4" && address_family != "v6" && address_family != "mixed")) {
+        fatal("usage: sim-network [nodes] [tree|random|chain] [seconds] [seed] [loss] [fanout] "
+              "[v4|v6|mixed] [failover]");
+    }
+
+    // Protocol errors (rejected SYNC_STARTs and the like) are routine at this
+    // scale; keep them off the terminal.
+    cerr.rdbuf(nullptr);
+
+    Simulator sim(nodes, topology, loss, fanout, failover, seed);
+    auto leader_at = SyncClock::time_point(JOIN_INTERVAL * static_cast<int64_t>(nodes) + seconds(1));
+    auto end = leader_at + duration_cast<nanoseconds>(duration<double>(seconds_));
+
+    auto wall_start = steady_clock::now();
+    sim.run(leader_at, end);
+    double wall = duration<double>(steady_clock::now() - wall_start).count();
+    sim.report(wall);
+    return 0;
+}
@@ -0,0 +1,188 @@
+// Simulation of offset estimation over a lossy, jittery link.
+//
+// Usage: ./sim-offset [loss] [spike] [rounds] [seed] [drift_ppm] [interval]
+//   A leader and a follower whose clock is off by 3.7 ms (and drifts by
+//   drift_ppm, 0 by default) run one SYNC_START round every `interval`
+//   seconds (5 by default), each with
+//   EXCHANGES_PER_ROUND DELAY_REQUEST exchanges. Every one-way trip takes a base delay plus
+//   exponential queueing jitter; with probability `spike` (0.05 by default) a
+//   packet is held for 1-20 ms more, and with probability `loss` (0.1) it is
+//   dropped, which ends the round as the real node's 5 s timeout would.
+//   The single-exchange estimate (adopt the first sample of each round, as the
+//   node used to) is compared with OffsetEstimator fed with every sample,
+//   once holding the offset constant between rounds and once tracking the
+//   drift, as the node does. The error is taken just before each round, when
+//   the clock has gone longest without a sample.
+//   Reported: when the error first stays below 100 us for 10 rounds in a row,
+//   and from then on the mean, standard deviation (jitter), 99th percentile
+//   and maximum of the error.
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "err.h"
+#include "offset_estimator.h"
+#include "sync_node.h"
+
+using namespace std;
+using namespace chrono;
+
+constexpr int EXCHANGES = SyncNode::EXCHANGES_PER_ROUND;
+
+constexpr double BASE_DELAY_S    = 200e-6;
+constexpr double JITTER_MEAN_S   = 100e-6;
+constexpr double PROCESSING_S    = 50e-6;       // Follower turnaround.
+constexpr double TRUE_OFFSET_S   = 3.7e-3;      // Follower clock minus leader clock at t = 0.
+constexpr double CONVERGED_S     = 100e-6;
+constexpr size_t CONVERGED_ROUNDS = 10;
+
+static double drift = 0;                        // Follower rate error.
+static double round_s = 5.0;                    // Time between rounds.
+
+struct Link {
+    mt19937_64 rng;
+    double loss;
+    double spike;
+
+    // Returns the one-way delay of a packet, or nothing if it is lost.
+    optional<double> trip() {
+        uniform_real_distribution<double> unit(0.0, 1.0);
+        if (unit(rng) < loss) return nullopt;
+        double d = BASE_DELAY_S + exponential_distribution<double>(1.0 / JITTER_MEAN_S)(rng);
+        if (unit(rng) < spike) d += uniform_real_distribution<double>(1e-3, 20e-3)(rng);
+        return d;
+    }
+};
+
+// Follower clock at leader (true) time t.
+static double follower_clock(double t) {
+    return t + TRUE_OFFSET_S + drift * t;
+}
+
+static nanoseconds ns(double s) {
+    return nanoseconds(static_cast<nanoseconds::rep>(llround(s * 1e9)));
+}
+
+// The follower's SyncClock reading at leader time t.
+static SyncClock::time_point local(double t) {
+    return SyncClock::time_point(ns(follower_clock(t)));
+}
+
+struct Result {
+    string name;
+    vector<double> time;        // End of each completed round.
+    vector<double> error;       // Applied offset minus true offset, in seconds.
+};
+
+static void report(const Result &r) {
+    // Converged at the start of the first run of CONVERGED_ROUNDS small errors.
+    size_t from = 0, run = 0;
+    for (; from + run < r.error.size() && run < CONVERGED_ROUNDS; ) {
+        if (fabs(r.error[from + run]) < CONVERGED_S) {
+            ++run;
+        } else {
+            from += run + 1;
+            run = 0;
+        }
+    }
+
+    cout << left << setw(20) << r.name << right;
+    if (run < CONVERGED_ROUNDS) {
+        cout << "  never converged\n";
+        return;
+    }
+    vector<double> magnitude;
+    double sum = 0, sq = 0;
+    for (size_t i = from; i < r.error.size(); ++i) {
+        sum += r.error[i];
+        magnitude.push_back(fabs(r.error[i]));
+    }
+    double n = static_cast<double>(magnitude.size());
+    double mean = sum / n;
+    for (size_t i = from; i < r.error.size(); ++i) sq += (r.error[i] - mean) * (r.error[i] - mean);
+    sort(magnitude.begin(), magnitude.end());
+    double p99 = magnitude[static_cast<size_t>(0.99 * (n - 1))];
+    cout << fixed << setprecision(1)
+         << setw(12) << r.time[from] << " s"
+         << setw(12) << mean * 1e6 << " us"
+         << setw(12) << sqrt(sq / n) * 1e6 << " us"
+         << setw(12) << p99 * 1e6 << " us"
+         << setw(12) << magnitude.back() * 1e6 << " us\n";
+}
+
+int main(int argc, char *argv[]) {
+    double loss   = argc > 1 ? strtod(argv[1], nullptr) : 0.1;
+    double spike  = argc > 2 ? strtod(argv[2], nullptr) : 0.05;
+    size_t rounds = argc > 3 ? strtoul(argv[3], nullptr, 10) : 2000;
+    uint64_t seed = argc > 4 ? strtoull(argv[4], nullptr, 10) : 1;
+    drift         = argc > 5 ? strtod(argv[5], nullptr) * 1e-6 : 0;
+    round_s       = argc > 6 ? strtod(argv[6], nullptr) : 5.0;
+    if (rounds == 0 || loss < 0 || loss >= 1 || spike < 0 || spike > 1 || !(round_s >= 0.1)) {
+        fatal("usage: sim-offset [loss] [spike] [rounds] [seed] [drift_ppm] [interval]");
+    }
+
+    Link link{mt19937_64(seed), loss, spike};
+    OffsetEstimator constant(microseconds(500), milliseconds(128), false);
+    OffsetEstimator estimator;
+    optional<double> single;
+    Result single_result{"single exchange", {}, {}};
+    Result constant_result{"offset only", {}, {}};
+    Result filtered_result{"offset and drift", {}, {}};
+
+    for (size_t round = 0; round < rounds; ++round) {
+        // Measure the error the clock has reached just before this round.
+        double t = static_cast<double>(round) * round_s;
+        if (single) {
+            double truth = follower_clock(t) - t;
+            single_result.time.push_back(t);
+            single_result.error.push_back(*single - truth);
+            constant_result.time.push_back(t);
+            constant_result.error.push_back(
+                static_cast<double>(constant.offset_at(local(t)).count()) * 1e-9 - truth);
+            filtered_result.time.push_back(t);
+            filtered_result.error.push_back(
+                static_cast<double>(estimator.offset_at(local(t)).count()) * 1e-9 - truth);
+        }
+
+        auto forward = link.trip();
+        if (!forward) continue;
+        double T1 = t;
+        double T2 = follower_clock(t + *forward);
+        double now = t + *forward;
+
+        for (int k = 0; k < EXCHANGES; ++k) {
+            now += PROCESSING_S;
+            double T3 = follower_clock(now);
+            auto out = link.trip();
+            if (!out) break;
+            double T4 = now + *out;
+            auto back = link.trip();
+            if (!back) break;
+            now = T4 + *back;
+
+            double offset = (T2 - T1 + T3 - T4) / 2;
+            double round_trip = (T4 - T1) - (T3 - T2);
+            if (k == 0) single = offset;
+            constant.add(ns(offset), ns(round_trip), local(now));
+            estimator.add(ns(offset), ns(round_trip), local(now));
+        }
+    }
+
+    cout << "Rounds " << rounds << ", loss " << loss << ", spike " << spike
+         << ", " << EXCHANGES << " exchanges per round every " << round_s << " s, drift "
+         << drift * 1e6 << " ppm (estimated " << estimator.drift() * 1e6 << ")\n";
+    cout << left << setw(20) << "estimator" << right
+         << setw(14) << "converged" << setw(15) << "mean err"
+         << setw(15) << "jitter" << setw(15) << "p99 |err|" << setw(15) << "max |err|" << "\n";
+    report(single_result);
+    report(constant_result);
+    report(filtered_result);
+    return 0;
+}
@@ -0,0 +1,33 @@
+#ifndef SYNC_CLOCK_H
+#define SYNC_CLOCK_H
+
+#include <chrono>
+#include <ctime>
+
+// The SyncClock is the clock all synchronization timestamps (T1-T4, the
+// offset and the readings sent in SYNC_START, DELAY_RESPONSE and TIME) are
+// taken from. It reads CLOCK_MONOTONIC_RAW, which ticks in nanoseconds and,
+// unlike CLOCK_MONOTONIC, is never slewed by NTP or adjtime, so the offset we
+// compute is not disturbed by another daemon disciplining the same host.
+struct SyncClock {
+    using duration   = std::chrono::nanoseconds;
+    using rep        = duration::rep;
+    using period     = duration::period;
+    using time_point = std::chrono::time_point<SyncClock>;
+    static constexpr bool is_steady = true;
+
+    // Reads the clock with a single vDSO call and no other work, so callers
+    // can take it immediately before or after the system call they time.
+    static time_point now() noexcept {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+        return time_point(std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec));
+    }
+};
+
+// Converts a timespec to a duration since its clock's epoch.
+inline std::chrono::nanoseconds to_duration(const timespec &ts) {
+    return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+}
+
+#endif // SYNC_CLOCK_H
@@ -0,0 +1,775 @@
+#include "sync_node.h"
+#include "err.h"
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+using namespace std;
+using namespace std::chrono;
+
+SyncNode::SyncNode(Transport &node_transport, Clock &node_clock, const Endpoint &self,
+                   optional<Endpoint> contact_addr, size_t fanout, bool can_lead,
+                   double get_time_rate)
+    : transport(node_transport),
+      clock(node_clock),
+      self_addr(self),
+      contact(contact_addr),
+      membership(self, Endpoint::Hash{}(self) ^
+                           static_cast<uint64_t>(node_clock.now().time_since_epoch().count())),
+      max_children(fanout),
+      last_shuffle(node_clock.now()),
+      start_time(node_clock.now()),
+      last_start(start_time),
+      electable(can_lead),
+      time_limiter(get_time_rate, get_time_rate, get_time_rate > 0 ? GET_TIME_TOTAL_RATE : 0),
+      request_limiter(DELAY_REQUEST_RATE, 2 * EXCHANGES_PER_ROUND),
+      send_buf(MAX_UDP_PAYLOAD),
+      sync_start(level, Precision::MILLISECONDS),
+      sync_start_ns(level, Precision::NANOSECONDS) {}
+
+void SyncNode::start() {
+    if (!contact) return;
+    if (!send_message(make_HELLO(), *contact, "HELLO")) {
+        syserr("sendto HELLO failed");
+    }
+}
+
+bool SyncNode::send_message(const Message &msg, const Endpoint &dest, const string &what) {
+    size_t len = encode(msg, send_buf);
+    if (len == 0) {
+        // np. przekroczono rozmiar UDP albo za dużo węzłów
+        error("send_message: cannot encode " + what);
+        return false;
+    }
+    return transport.send(send_buf.data(), len, dest);
+}
+
+// The message is encoded beforehand and T3 read right before sending, the
+// same way the source stamps T1 right before sending SYNC_START, so time
+// spent inside the system call counts towards the path delay on both legs.
+bool SyncNode::send_delay_request(const Endpoint &dest) {
+    static const vector<uint8_t> request = serialize(make_DELAY_REQUEST());
+    T3 = clock.now() - start_time;
+    return transport.send(request.data(), request.size(), dest);
+}
+
+uint64_t SyncNode::reported_accuracy() const {
+    if (level == 0) return 0;
+    if (level >= 254) return UNKNOWN_ACCURACY;
+    return static_cast<uint64_t>(accuracy.count());
+}
+
+nanoseconds SyncNode::reading() {
+    auto now = clock.now();
+    return clock_reading(level, start_time, offset_at(now), now);
+}
+
+nanoseconds SyncNode::offset_at(SyncClock::time_point at) const {
+    return estimator.offset_at(at);
+}
+
+// The deadlines mirror the checks in on_timer(), which compare whole seconds,
+// so they fire once a full extra second has passed.
+SyncClock::time_point SyncNode::next_timer() const {
+    SyncClock::time_point deadline = SyncClock::time_point::max();
+    if (level < 254) {
+        deadline = min(deadline, last_start + seconds(6));
+    }
+    if (!leader && synchronized_to.does_exist) {
+        deadline = min(deadline, synchronized_to.last_heard + seconds(21));
+    }
+    deadline = min(deadline, candidacy_ends);
+    return min(deadline, last_shuffle + SHUFFLE_PERIOD);
+}
+
+void SyncNode::on_timer() {
+    auto now = clock.now();
+
+    // If our current sync source has not responded in 20 seconds, reset.
+    // An electable node that lost a level-0 source runs for leader.
+    if (!leader && synchronized_to.does_exist &&
+        duration_cast<seconds>(now - synchronized_to.last_heard) > seconds(20)) {
+        bool lost_leader = synchronized_to.synchronization == 0;
+        uint64_t accuracy_ns = reported_accuracy();
+        synchronized_to.does_exist = false;
+        level = 255;
+        if (electable && lost_leader) stand_for_leader(now, accuracy_ns);
+    }
+
+    // A candidate that was neither outranked nor vetoed takes the lead. The
+    // offset moves into start_time, so its clock reads on as synchronized.
+    if (now >= candidacy_ends) {
+        start_time += offset_at(now);
+        lead(now, nanoseconds(0));
+    }
+
+    // Every 5 seconds (if not fully synchronized), send SYNC_START to all
+    // neighbours. The message is serialized once per synchronization level
+    // and precision, and restamped before every batch of peers.
+    if (level < 254 && duration_cast<seconds>(now - last_start) > seconds(5)) {
+        last_start = now;
+        if (sync_start.level() != level) {
+            sync_start = SyncStartTemplate(level, Precision::MILLISECONDS);
+            sync_start_ns = SyncStartTemplate(level, Precision::NANOSECONDS);
+        }
+        uint64_t accuracy_ns = reported_accuracy();
+        const PeerTable &peers = membership.active();
+        if (max_children > 0) select_offers(now);
+        const auto &ms_peers = max_children > 0 ? offers[0] : peers.addresses(Precision::MILLISECONDS);
+        const auto &ns_peers = max_children > 0 ? offers[1] : peers.addresses(Precision::NANOSECONDS);
+        transport.send_to_all(ms_peers,
+                              sync_start.data(), sync_start.size(),
+                              [&] {
+                                  auto at = clock.now();
+                                  sync_start.stamp(start_time, offset_at(at), UNKNOWN_ACCURACY, at);
+                              });
+        transport.send_to_all(ns_peers,
+                              sync_start_ns.data(), sync_start_ns.size(),
+                              [&] {
+                                  auto at = clock.now();
+                                  sync_start_ns.stamp(start_time, offset_at(at), accuracy_ns, at);
+                              });
+    }
+
+    if (now - last_shuffle >= SHUFFLE_PERIOD) {
+        last_shuffle = now;
+        maintain_membership();
+    }
+}
+
+// Children come first. The rest of the slots go to neighbours that could
+// adopt us: first those whose level we have not heard lately, which may have
+// no source at all, then those we would bring closer to the leader, and last
+// those that ignored an offer in the past 30 s; a synchronized node with
+// limited fan-out sends SYNC_START to few peers, so its level is often only
+// learnt that way. Those that recently advertised a level below ours + 2 are
+// skipped, as on_sync_start would refuse us there anyway. Within each group
+// the closest go first, and peers not measured yet before all of them.
+void SyncNode::select_offers(SyncClock::time_point now) {
+    const PeerTable &peers = membership.active();
+    auto fresh = now - seconds(11);         // Two rounds.
+    auto child_since = now - CHILD_TIMEOUT;
+    auto declined_since = now - seconds(30);
+    vector<size_t> order;
+    for (size_t i = 0; i < peers.size(); ++i) {
+        PeerState *p = membership.active().find(peers[i].address);
+        if (p->offered > SyncClock::time_point::min() && p->offered < now - seconds(5) &&
+            p->last_request < p->offered) {
+            p->declined = p->offered;
+        }
+        bool child = p->last_request >= child_since;
+        if (!child && p->sync_heard >= fresh && p->synchronization <= level + 1) continue;
+        order.push_back(i);
+    }
+    auto rank = [&](size_t i) {
+        const PeerState &p = peers[i];
+        int group = p.last_request >= child_since ? 0 : p.declined >= declined_since ? 3
+                  : p.sync_heard < fresh ? 1 : 2;
+        return make_pair(group, p.latency);
+    };
+    sort(order.begin(), order.end(), [&](size_t a, size_t b) { return rank(a) < rank(b); });
+    if (order.size() > max_children) order.resize(max_children);
+
+    offers[0].clear();
+    offers[1].clear();
+    for (size_t i : order) {
+        PeerState *p = membership.active().find(peers[i].address);
+        p->offered = now;
+        offers[static_cast<size_t>(p->precision)].push_back(p->address);
+    }
+}
+
+size_t SyncNode::children() const {
+    auto child_since = clock.now() - CHILD_TIMEOUT;
+    const PeerTable &peers = membership.active();
+    size_t n = 0;
+    for (size_t i = 0; i < peers.size(); ++i) {
+        if (peers[i].last_request >= child_since) ++n;
+    }
+    return n;
+}
+
+// A SHUFFLE trades a sample of both views for a sample of the neighbour's
+// passive view, so passive views keep mixing as nodes join and leave. A node
+// with room in its active view asks one passive peer per period to become
+// a neighbour; the request is forced only when it has no neighbours at all,
+// as a non-forced one may be refused by a full peer.
+//
+// Neighbours leave by DISCONNECT, but a crashed one sends none, so silent
+// neighbours are probed with a non-forced CONNECT: a live peer answers
+// ACK_CONNECT, or DISCONNECT if it no longer has room for us. Those that
+// stay silent are expired, which frees their slots for repair.
+void SyncNode::maintain_membership() {
+    auto now = clock.now();
+    membership.expire(now - NEIGHBOUR_TIMEOUT);
+    const PeerTable &peers = membership.active();
+    for (size_t i = 0; i < peers.size(); ++i) {
+        if (now - peers[i].last_heard >= NEIGHBOUR_PROBE &&
+            !send_message(make_CONNECT(), peers[i].address, "CONNECT")) {
+            error("message not send");
+        }
+    }
+
+    if (auto target = membership.random_neighbour()) {
+        size_t len = encode_contacts(SHUFFLE, membership.sample(Membership::SAMPLE, *target),
+                                     NODE_CAPABILITIES, 0, send_buf);
+        if (len == 0 || !transport.send(send_buf.data(), len, *target)) {
+            error("message not send");
+        }
+    }
+    if (auto target = membership.repair_target()) {
+        bool forced = membership.active().size() == 0;
+        if (!send_message(make_CONNECT(forced), *target, "CONNECT")) {
+            error("message not send");
+        }
+    }
+}
+
+// Only the two requests a node answers on demand are limited. Everything
+// else either needs the sender to be a neighbour or source already, or is
+// rare and cheap, and is left to the handlers.
+bool SyncNode::admissible(const uint8_t *data, size_t len, const Endpoint &sender,
+                          const PeerState *known, SyncClock::time_point received_at) {
+    if (len == 0) {
+        drop(dropped.malformed, "empty datagram", received_at);
+        return false;
+    }
+    switch (data[0]) {
+        case 12:
+            if (!known) {
+                drop(dropped.unknown_sender, "sender not known", received_at);
+                return false;
+            }
+            if (!request_limiter.allow(sender, received_at)) {
+                ++dropped.rate_limited;
+                return false;
+            }
+            return true;
+        case 31:
+            if (!time_limiter.allow(sender, received_at)) {
+                ++dropped.rate_limited;
+                return false;
+            }
+            return true;
+        case 1: case 2: case 3: case 4:
+        case DISCONNECT: case SHUFFLE: case SHUFFLE_REPLY: case FORWARD_JOIN:
+        case 11: case 13: case ELECTION: case 21:
+            return true;
+        default:
+            drop(dropped.malformed, "wrong message type", received_at);
+            return false;
+    }
+}
+
+void SyncNode::drop(uint64_t &counter, const string &what, SyncClock::time_point now) {
+    ++counter;
+    if (drop_log.take(DROP_LOG_RATE, DROP_LOG_RATE, now)) {
+        error(what);
+    }
+}
+
+void SyncNode::on_datagram(const uint8_t *data, size_t len, const Endpoint &sender,
+                           SyncClock::time_point received_at) {
+    // Drop floods and unknown types before any parsing.
+    PeerState *known = membership.active().find(sender);
+    if (!admissible(data, len, sender, known, received_at)) {
+        return;
+    }
+
+    // Validate the raw bytes; the view decodes fields in place.
+    if (!recvMsg.parse(data, len)) {
+        drop(dropped.malformed, string(reinterpret_cast<const char*>(data), min<size_t>(10, len)),
+             received_at);
+        return;
+    }
+
+    // Drop any packet that appears to originate from ourselves.
+    if (sender == self_addr) {
+        error("message from self ignored");
+        return;
+    }
+
+    // Refresh what we know about the sender, if it is a neighbour.
+    if (known) {
+        known->last_heard = clock.now();
+    }
+
+    // Dispatch based on the message code in the header.
+    switch (recvMsg.message()) {
+        case 1:  on_hello(sender); break;
+        case 2:  on_hello_reply(sender); break;
+        case 3:  on_connect(sender); break;
+        case 4:  on_ack_connect(sender); break;
+        case DISCONNECT:    on_disconnect(sender); break;
+        case SHUFFLE:       on_shuffle(sender); break;
+        case SHUFFLE_REPLY: on_shuffle_reply(); break;
+        case FORWARD_JOIN:  on_forward_join(sender); break;
+        case 11: on_sync_start(sender, known, received_at); break;
+        case 12: on_delay_request(sender, known, received_at); break;
+        case 13: on_delay_response(sender); break;
+        case ELECTION:      on_election(sender); break;
+        case 21: on_leader(); break;
+        case 31: on_get_time(sender); break;
+        default:
+            // Unrecognized message code.
+            error("wrong message type");
+    }
+}
+
+bool SyncNode::admit(const Endpoint &sender, bool forced) {
+    optional<Endpoint> evicted;
+    bool admitted = membership.admit(sender, advertised_precision(recvMsg),
+                                     advertises_gossip(recvMsg), forced, clock.now(), evicted);
+    if (evicted && !send_message(make_DISCONNECT(), *evicted, "DISCONNECT")) {
+        error("message not send");
+    }
+    return admitted;
+}
+
+// HELLO: reply with HELLO_REPLY and take the joiner as a neighbour. A gossip
+// joiner gets a random sample of both views for its passive view, and a
+// FORWARD_JOIN walk starts from every other neighbour to find it more. An old
+// joiner expects every peer it should CONNECT to, so it gets the whole
+// active view, less the IPv6 neighbours it could not parse.
+void SyncNode::on_hello(const Endpoint &sender) {
+    bool gossip = advertises_gossip(recvMsg);
+    size_t reply_len;
+    if (gossip) {
+        reply_len = encode_contacts(2, membership.sample(Membership::SAMPLE, sender),
+                                    NODE_CAPABILITIES, 0, send_buf);
+    } else {
+        vector<Endpoint> v4_neighbours;
+        for (const auto &a : membership.active().addresses()) {
+            if (a.is_v4()) v4_neighbours.push_back(a);
+        }
+        reply_len = encode_HELLO_REPLY(v4_neighbours, send_buf);
+    }
+    if (reply_len == 0 || !transport.send(send_buf.data(), reply_len, sender)) {
+        error("message not send");
+    }
+    if (gossip) {
+        for (size_t i = 0; i < membership.active().size(); ++i) {
+            const PeerState &peer = membership.active()[i];
+            if (peer.gossip && peer.address != sender) {
+                forward_join(sender, Membership::ACTIVE_WALK, peer.address);
+            }
+        }
+    }
+    admit(sender, true);
+}
+
+bool SyncNode::forward_join(const Endpoint &joiner, uint8_t hops, const Endpoint &dest) {
+    size_t len = encode_contacts(FORWARD_JOIN, {joiner}, NODE_CAPABILITIES, hops, send_buf);
+    if (len == 0 || !transport.send(send_buf.data(), len, dest)) {
+        error("message not send");
+        return false;
+    }
+    return true;
+}
+
+// FORWARD_JOIN: pass the walk on to a random neighbour, or end it here by
+// taking the joiner as a neighbour when no hops are left or nobody else is
+// there to pass it to.
+void SyncNode::on_forward_join(const Endpoint &sender) {
+    vector<Endpoint> contacts;
+    if (!read_contacts(recvMsg, contacts) || contacts.size() != 1) {
+        error("FORWARD_JOIN");
+        return;
+    }
+    const Endpoint &joiner = contacts[0];
+    if (joiner == self_addr) return;
+    uint8_t hops = recvMsg.synchronized();
+
+    if (hops > 0) {
+        if (hops == Membership::PASSIVE_WALK) membership.remember(joiner);
+        if (auto next = membership.random_neighbour({sender, joiner})) {
+            forward_join(joiner, static_cast<uint8_t>(hops - 1), *next);
+            return;
+        }
+    }
+    if (membership.active().contains(joiner)) return;
+
+    optional<Endpoint> evicted;
+    membership.admit(joiner, Precision::NANOSECONDS, true, true, clock.now(), evicted);
+    if (evicted && !send_message(make_DISCONNECT(), *evicted, "DISCONNECT")) {
+        error("message not send");
+    }
+    if (!send_message(make_CONNECT(true), joiner, "CONNECT")) {
+        error("message not send");
+    }
+}
+
+// HELLO_REPLY: validate the contact list and keep the contacts as passive
+// peers. The contact's FORWARD_JOIN walks bring in neighbours; a contact
+// without gossip starts none, so a few of its contacts get a CONNECT instead.
+void SyncNode::on_hello_reply(const Endpoint &sender) {
+    if (!contact || sender != *contact) {
+        error("HELLO_REPLY");
+        return;
+    }
+    vector<Endpoint> contacts;
+    if (!read_contacts(recvMsg, contacts)) {
+        error("HELLO_REPLY");
+        return;
+    }
+    // The reply must not list the contact itself or this node.
+    for (const auto &c : contacts) {
+        if (c == sender ||
+            c == self_addr) {
+            error("HELLO_REPLY");
+            return;
+        }
+    }
+    bool walks = advertises_gossip(recvMsg);
+    admit(sender, true);
+    for (size_t i = 0; i < contacts.size(); ++i) {
+        if (!walks && i < Membership::JOIN_CONNECTS) {
+            if (!send_message(make_CONNECT(true), contacts[i], "CONNECT")) {
+                error("message not send");
+            }
+        } else {
+            membership.remember(contacts[i]);
+        }
+    }
+}
+
+bool SyncNode::read_contacts(const MessageView &msg, vector<Endpoint> &contacts) {
+    // MessageView::parse already checked that count records are present.
+    contacts.reserve(msg.count());
+    for (NodeView rec : msg) {
+        // peer_address_length must be 4 (IPv4) or 16 (IPv6), and peer_port
+        // must be non-zero.
+        if (rec.peer_port == 0) return false;
+        auto peer = Endpoint::from_bytes(rec.peer_address, rec.peer_address_length, rec.peer_port);
+        if (!peer) return false;
+        contacts.push_back(*peer);
+    }
+    return true;
+}
+
+// CONNECT: acknowledge with ACK_CONNECT if the sender was admitted. A gossip
+// peer that sent a non-forced CONNECT to a full view is refused with
+// DISCONNECT and kept as a passive peer.
+void SyncNode::on_connect(const Endpoint &sender) {
+    bool forced = !advertises_gossip(recvMsg) || recvMsg.synchronized() == CONNECT_FORCED;
+    if (admit(sender, forced)) {
+        if (!send_message(make_ACK_CONNECT(), sender, "ACK_CONNECT")) {
+            error("message not send");
+        }
+    } else {
+        membership.remember(sender);
+        if (!send_message(make_DISCONNECT(), sender, "DISCONNECT")) {
+            error("message not send");
+        }
+    }
+}
+
+// ACK_CONNECT: the sender accepted us as a neighbour.
+void SyncNode::on_ack_connect(const Endpoint &sender) {
+    admit(sender, true);
+}
+
+// DISCONNECT: the sender dropped us from its active view or refused our
+// CONNECT; it stays known as a passive peer. If it was our sync source, the
+// source timeout lets us pick another neighbour.
+void SyncNode::on_disconnect(const Endpoint &sender) {
+    if (!membership.demote(sender)) {
+        membership.remember(sender);
+    }
+}
+
+// SHUFFLE: answer with a sample of the passive view, then merge the sender's.
+void SyncNode::on_shuffle(const Endpoint &sender) {
+    vector<Endpoint> contacts;
+    if (!read_contacts(recvMsg, contacts)) {
+        error("SHUFFLE");
+        return;
+    }
+    size_t len = encode_contacts(SHUFFLE_REPLY, membership.sample_passive(Membership::SAMPLE),
+                                 NODE_CAPABILITIES, 0, send_buf);
+    if (len == 0 || !transport.send(send_buf.data(), len, sender)) {
+        error("message not send");
+    }
+    for (const auto &c : contacts) membership.remember(c);
+}
+
+// SHUFFLE_REPLY: merge the neighbour's passive sample.
+void SyncNode::on_shuffle_reply() {
+    vector<Endpoint> contacts;
+    if (!read_contacts(recvMsg, contacts)) {
+        error("SHUFFLE_REPLY");
+        return;
+    }
+    for (const auto &c : contacts) membership.remember(c);
+}
+
+// SYNC_START: initiate delay request if conditions permit.
+void SyncNode::on_sync_start(const Endpoint &sender, PeerState *known,
+                             SyncClock::time_point received_at) {
+    if (leader) {
+        error("is leader");
+        return;
+    }
+
+    // If already synchronizing, skip or timeout.
+    if (synchronized_to.does_exist && synchronized_to.is(sender)) {
+        synchronized_to.last_heard = clock.now();
+        if (recvMsg.synchronized() >= level) {
+            level = 255;
+            synchronized_to.does_exist = false;
+        }
+    }
+
+    // Validate peer is known and sync level is acceptable.
+    if (synchronizing_to.does_exist) {
+        if (duration_cast<milliseconds>(clock.now() - start_time - T3) > seconds(5)) {
+            synchronizing_to.does_exist = false;
+        }
+        if (synchronizing_to.does_exist) {
+            error("already synchronizing");
+            return;
+        }
+    }
+    if (!known) {
+        error("sender not known");
+        return;
+    }
+    known->synchronization = recvMsg.synchronized();
+    known->sync_heard = clock.now();
+
+    if (recvMsg.synchronized() >= 254) {
+        error("too low sync level");
+        return;
+    }
+
+    if (synchronized_to.does_exist) {
+        if (synchronized_to.is(sender)) {
+            if (recvMsg.synchronized() >= level) {
+                error("too low sync level");
+                return;
+            }
+        } else {
+            if (recvMsg.synchronized() >= level - 1) {
+                error("too low sync level");
+                return;
+            }
+        }
+    }
+
+    // Record timestamps and send DELAY_REQUEST. T2 is when the datagram
+    // reached the socket, not when we got to it.
+    uint64_t sender_accuracy = UNKNOWN_ACCURACY;
+    T1 = from_wire(recvMsg.timestamp(), message_precision(recvMsg, sender_accuracy));
+    T2 = received_at - start_time;
+    synchronizing_to.peer = sender;
+    synchronizing_to.synchronization = recvMsg.synchronized();
+    synchronizing_to.does_exist = true;
+    synchronizing_to.last_heard = clock.now();
+    exchanges_left = EXCHANGES_PER_ROUND - 1;
+
+    if (!send_delay_request(sender)) {
+        error("message not send");
+        synchronizing_to.does_exist = false;
+    }
+}
+
+// DELAY_REQUEST: respond with DELAY_RESPONSE.
+void SyncNode::on_delay_request(const Endpoint &sender, PeerState *known,
+                                SyncClock::time_point received_at) {
+    if (!known) {
+        error("sender not known");
+        return;
+    }
+    if (max_children > 0) {
+        // Only peers offered SYNC_START in the last round may adopt us. The
+        // first request of a round measures how far the peer is.
+        if (known->offered < received_at - seconds(6)) {
+            error("not offered");
+            return;
+        }
+        if (known->last_request < last_start) {
+            nanoseconds sample = received_at - last_start;
+            known->latency = known->latency == nanoseconds(0)
+                ? sample : (3 * known->latency + sample) / 4;
+        }
+    }
+    known->last_request = received_at;
+    // The reading is taken at reception, which is T4 proper.
+    Message msg = make_DELAY_RESPONSE(level, start_time, offset_at(received_at), known->precision,
+                                      reported_accuracy(), received_at);
+    if (!send_message(msg, sender, "DELAY_RESPONSE")) {
+        error("message not send");
+    }
+}
+
+// DELAY_RESPONSE: compute one-way delay offset.
+void SyncNode::on_delay_response(const Endpoint &sender) {
+    if (leader) {
+        synchronizing_to.does_exist = false;
+        error("received by leader");
+        return;
+    }
+    uint64_t source_accuracy = UNKNOWN_ACCURACY;
+    Precision precision = message_precision(recvMsg, source_accuracy);
+    T4 = from_wire(recvMsg.timestamp(), precision);
+    // Validate matching sync request context.
+    if (!synchronizing_to.does_exist) {
+        return;
+    } else if (!synchronizing_to.is(sender)) {
+        error("wrong sender");
+        return;
+    } else if (synchronizing_to.synchronization != recvMsg.synchronized()) {
+        synchronizing_to.does_exist = false;
+        error("synchronization has finished");
+        return;
+    } else if (duration_cast<milliseconds>(T4 - T1) > seconds(5)) {
+        synchronizing_to.does_exist = false;
+        error("timeout");
+        return;
+    } else if (duration_cast<milliseconds>(clock.now() - start_time - T3) > seconds(5)) {
+        synchronizing_to.does_exist = false;
+        error("timeout");
+        return;
+    } else if (T1 > T4) {
+        // Check for unreasonable delay
+        error("negative delay detected");
+        return;
+    }
+
+    // Feed the sample to the estimator, which starts over when the source
+    // changes, and update sync level.
+    if (!synchronized_to.does_exist || !synchronized_to.is(sender)) {
+        estimator.reset();
+    }
+    estimator.add((T2 - T1 + T3 - T4) / 2, (T4 - T1) - (T3 - T2), clock.now());
+    level = recvMsg.synchronized() + 1;
+
+    // The offset is off by at most the one-way delay of the best samples (the
+    // path may be fully asymmetric), plus the source's own error, plus a tick
+    // when it only sent milliseconds.
+    accuracy = estimator.round_trip() / 2;
+    if (precision == Precision::MILLISECONDS) {
+        accuracy += milliseconds(1);
+    } else {
+        // A bogus value must not overflow; no exchange survives an error
+        // beyond the 5 s timeouts.
+        accuracy += nanoseconds(static_cast<nanoseconds::rep>(
+            min<uint64_t>(source_accuracy, nanoseconds(seconds(5)).count())));
+    }
+
+    synchronizing_to.does_exist = false;
+    synchronized_to.peer = sender;
+    synchronized_to.synchronization = recvMsg.synchronized();
+    synchronized_to.last_heard = clock.now();
+    synchronized_to.does_exist = true;
+
+    // Run the next exchange of this round right away.
+    if (exchanges_left > 0) {
+        --exchanges_left;
+        synchronizing_to.does_exist = send_delay_request(sender);
+        if (!synchronizing_to.does_exist) error("message not send");
+    }
+}
+
+void SyncNode::lead(SyncClock::time_point now, nanoseconds first_round) {
+    leader = true;
+    level = 0;
+    synchronized_to.does_exist = false;
+    synchronizing_to.does_exist = false;
+    accuracy = nanoseconds(0);
+    estimator.reset();
+    candidacy_ends = SyncClock::time_point::max();
+    // on_timer() starts a round once six whole seconds have passed since
+    // last_start.
+    last_start = now - seconds(6) + first_round;
+}
+
+// LEADER: handle leadership announcement or resignation. The first round
+// waits LEADER_DELAY on the timer, so messages keep being handled meanwhile.
+void SyncNode::on_leader() {
+    if (recvMsg.synchronized() == 0 && !leader) {
+        lead(clock.now(), LEADER_DELAY);
+    } else if (recvMsg.synchronized() == 255 && leader) {
+        synchronized_to.does_exist = false;
+        leader = false;
+        level = 255;
+    } else {
+        error("invalid LEADER message");
+    }
+}
+
+void SyncNode::stand_for_leader(SyncClock::time_point now, uint64_t accuracy_ns) {
+    if (now < ballot.until && !ballot.beaten_by(self_addr, accuracy_ns)) return;
+    ballot = Ballot{self_addr, accuracy_ns, now + BALLOT_PERIOD};
+    candidacy_ends = now + ELECTION_WAIT;
+    flood_ballot(self_addr);
+}
+
+bool SyncNode::send_election(const Endpoint &candidate, uint64_t accuracy_ns, uint8_t kind,
+                             const Endpoint &dest) {
+    size_t len = encode_contacts(ELECTION, {candidate}, accuracy_ns, kind, send_buf);
+    if (len == 0 || !transport.send(send_buf.data(), len, dest)) {
+        error("message not send");
+        return false;
+    }
+    return true;
+}
+
+void SyncNode::flood_ballot(const Endpoint &except) {
+    const PeerTable &peers = membership.active();
+    for (size_t i = 0; i < peers.size(); ++i) {
+        const Endpoint &peer = peers[i].address;
+        if (peers[i].gossip && peer != except && peer != ballot.candidate) {
+            send_election(ballot.candidate, ballot.accuracy, 0, peer);
+        }
+    }
+}
+
+// ELECTION: veto the candidate while a leader is heard of; otherwise pass a
+// better candidate on, standing down if this node was running, and answer a
+// worse one with the best candidate known.
+void SyncNode::on_election(const Endpoint &sender) {
+    vector<Endpoint> contacts;
+    if (!read_contacts(recvMsg, contacts) || contacts.size() != 1) {
+        error("ELECTION");
+        return;
+    }
+    const Endpoint &candidate = contacts[0];
+    uint64_t candidate_accuracy = recvMsg.timestamp();
+    auto now = clock.now();
+
+    if (recvMsg.synchronized() == ELECTION_VETO) {
+        if (candidate == self_addr) candidacy_ends = SyncClock::time_point::max();
+        return;
+    }
+    if (candidate == self_addr) return;
+
+    bool leader_heard = leader ||
+        (synchronized_to.does_exist && synchronized_to.synchronization == 0 &&
+         now - synchronized_to.last_heard < LEADER_ALIVE);
+    if (leader_heard) {
+        send_election(candidate, candidate_accuracy, ELECTION_VETO, candidate);
+        return;
+    }
+
+    if (now < ballot.until && !ballot.beaten_by(candidate, candidate_accuracy)) {
+        if (ballot.candidate != candidate) {
+            send_election(ballot.candidate, ballot.accuracy, 0, sender);
+        }
+        return;
+    }
+    ballot = Ballot{candidate, candidate_accuracy, now + BALLOT_PERIOD};
+    candidacy_ends = SyncClock::time_point::max();
+    flood_ballot(sender);
+}
+
+// GET_TIME: provide current time reading, in nanoseconds together with our
+// accuracy if the client asked for it.
+void SyncNode::on_get_time(const Endpoint &sender) {
+    auto now = clock.now();
+    Message resp = make_TIME(level, start_time, offset_at(now), advertised_precision(recvMsg),
+                             reported_accuracy(), now);
+    if (!send_message(resp, sender, "TIME")) {
+        error("message not send");
+    }
+}
@@ -0,0 +1,327 @@
+#ifndef SYNC_NODE_H
+#define SYNC_NODE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <functional>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "message.h"
+#include "endpoint.h"
+#include "batch_io.h"
+#include "peer_table.h"
+#include "rate_limiter.h"
+#include "membership.h"
+#include "sync_clock.h"
+#include "offset_estimator.h"
+
+// The SyncNode class is the protocol state machine of one peer-time-sync
+// node: membership (HELLO, CONNECT and the gossip messages of Membership),
+// the SYNC_START / DELAY_REQUEST exchange, LEADER, leader election and
+// GET_TIME. It owns no socket and reads no system clock. Datagrams
+// go out through a Transport and time comes from a Clock, both supplied by
+// the caller, so the same code runs on a UDP socket in peer-time-sync and on
+// a virtual network in sim-network.
+//
+// The driver feeds every received datagram to on_datagram(), and calls
+// on_timer() whenever next_timer() is due. No handler blocks: waits, such as
+// the one between LEADER and the first SYNC_START, are timers.
+//
+// Flood protection: GET_TIME and DELAY_REQUEST are the only requests a
+// node answers without state of its own, so they go through per-sender
+// token buckets, and DELAY_REQUEST is taken from neighbours only. Both
+// checks look at the type byte and the sender alone and run before the
+// datagram is parsed, so a flood costs a hash lookup per datagram rather
+// than a parse, a reply and an error line. Dropped datagrams are counted in
+// drops(); their ERROR lines are themselves limited to a few a second.
+//
+// Election: when a node at level 1 stops hearing its level-0 source, it may
+// run for leader if it is electable. It floods an ELECTION over the gossip
+// views. Every node keeps the best candidate it has heard of for
+// BALLOT_PERIOD, ranked by clock error and then by address. A node forwards
+// a better candidate and answers a worse one with the best it knows. A
+// leader, or a level-1 node that heard its source within LEADER_ALIVE,
+// vetoes the election instead. A candidate that is still the best it knows
+// after ELECTION_WAIT becomes leader. It keeps its synchronized clock, so
+// the cluster's time carries on across the failover.
+class SyncNode {
+public:
+    // Sends datagrams on behalf of the node.
+    class Transport {
+    public:
+        virtual ~Transport() = default;
+
+        // Sends one datagram. Returns false if it could not be sent.
+        virtual bool send(const uint8_t *data, size_t len, const Endpoint &dest) = 0;
+
+        // Sends the same datagram to every destination; before_batch runs
+        // before each group of datagrams and may restamp the payload, as for
+        // ::send_to_all. Returns the number of datagrams sent.
+        virtual size_t send_to_all(const std::vector<Endpoint> &destinations,
+                                   const uint8_t *data, size_t len,
+                                   const std::function<void()> &before_batch) = 0;
+    };
+
+    // Tells the node what time it is.
+    class Clock {
+    public:
+        virtual ~Clock() = default;
+
+        // Returns the current time of the SyncClock, or its simulated stand-in.
+        virtual SyncClock::time_point now() = 0;
+    };
+
+    // Number of DELAY_REQUEST exchanges run against the source per SYNC_START.
+    // Each one reuses T1 and T2 and gives the OffsetEstimator another sample.
+    static constexpr int EXCHANGES_PER_ROUND = 4;
+
+    // A peer that sent a DELAY_REQUEST this long ago or less is a child.
+    static constexpr std::chrono::seconds CHILD_TIMEOUT{20};
+
+    // How often the node SHUFFLEs with a neighbour and, if its active view
+    // has room, asks a passive peer to become a neighbour.
+    static constexpr std::chrono::seconds SHUFFLE_PERIOD{10};
+
+    // A neighbour silent for NEIGHBOUR_PROBE gets a CONNECT at every
+    // membership upkeep, which a live peer answers; one silent for
+    // NEIGHBOUR_TIMEOUT is taken for crashed and moved to the passive view.
+    static constexpr std::chrono::seconds NEIGHBOUR_PROBE{20};
+    static constexpr std::chrono::seconds NEIGHBOUR_TIMEOUT{45};
+
+    // Time between LEADER and the new leader's first SYNC_START.
+    static constexpr std::chrono::seconds LEADER_DELAY{2};
+
+    // How long a candidate waits for better candidates or a veto, how long a
+    // node remembers the best candidate, and how recently a level-1 node must
+    // have heard its source to veto an election.
+    static constexpr std::chrono::seconds ELECTION_WAIT{2};
+    static constexpr std::chrono::seconds BALLOT_PERIOD{10};
+    static constexpr std::chrono::seconds LEADER_ALIVE{11};
+
+    // Default GET_TIME requests answered per sender and second, and in
+    // total over all senders. A sender may send a second's worth at once.
+    static constexpr double GET_TIME_RATE = 50;
+    static constexpr double GET_TIME_TOTAL_RATE = 20000;
+
+    // DELAY_REQUESTs answered per neighbour and second; a round takes
+    // EXCHANGES_PER_ROUND in a burst every 5 s.
+    static constexpr double DELAY_REQUEST_RATE = 2;
+
+    // ERROR lines printed per second for dropped datagrams.
+    static constexpr double DROP_LOG_RATE = 10;
+
+    // Datagrams dropped before they were handled, by reason.
+    struct Drops {
+        uint64_t malformed = 0;         // Truncated, or with an unknown type.
+        uint64_t unknown_sender = 0;    // DELAY_REQUEST from a non-neighbour.
+        uint64_t rate_limited = 0;      // Over the sender's or the total rate.
+
+        uint64_t total() const { return malformed + unknown_sender + rate_limited; }
+    };
+
+    // self is the address the node is bound to; contact, if given, is the
+    // peer it introduces itself to with HELLO in start().
+    //
+    // A non-zero fanout makes the node serve at most that many children, the
+    // peers that synchronize to it. Each round it sends SYNC_START only to
+    // its children and, while there is room, to neighbours that may still
+    // become children, closest first, and it answers DELAY_REQUEST only from
+    // the peers it sent SYNC_START to. The sync tree then has bounded
+    // degree, so the load on the leader, and on every other node, does not
+    // grow with the cluster. With 0 every neighbour gets SYNC_START.
+    //
+    // An electable node runs for leader when it loses a level-0 source.
+    // Every node relays ELECTIONs and vetoes them while it hears a leader.
+    //
+    // get_time_rate is the number of GET_TIME requests answered per sender
+    // and second; 0 answers all of them.
+    SyncNode(Transport &transport, Clock &clock, const Endpoint &self,
+             std::optional<Endpoint> contact = std::nullopt, size_t fanout = 0,
+             bool electable = false, double get_time_rate = GET_TIME_RATE);
+
+    // Sends the initial HELLO to the contact, if any.
+    void start();
+
+    // Handles one datagram from sender that arrived at received_at.
+    void on_datagram(const uint8_t *data, size_t len, const Endpoint &sender,
+                     SyncClock::time_point received_at);
+
+    // Runs the timer-driven actions: the source timeout, SYNC_START rounds
+    // and membership upkeep.
+    void on_timer();
+
+    // Returns when on_timer() is next due: the next SYNC_START round, the
+    // sync source timeout, the end of a candidacy or the next SHUFFLE. The 5 s
+    // timeouts of an ongoing exchange are only checked when a message arrives,
+    // so they do not need a wakeup of their own.
+    SyncClock::time_point next_timer() const;
+
+    // Returns the node's clock reading at its current time, as TIME reports it.
+    std::chrono::nanoseconds reading();
+
+    // Returns the number of peers currently synchronizing to this node.
+    size_t children() const;
+
+    // Returns the accuracy this node reports in nanosecond messages.
+    uint64_t reported_accuracy() const;
+
+    // Returns the offset applied at local time at: the last estimate carried
+    // on at the estimated drift of the local clock.
+    std::chrono::nanoseconds offset_at(SyncClock::time_point at) const;
+
+    // The parameters of reading(), as published on the time page: the
+    // offset is clock_offset() at offset_reference(), changing by drift()
+    // nanoseconds per nanosecond.
+    SyncClock::time_point epoch() const { return start_time; }
+    std::chrono::nanoseconds clock_offset() const { return estimator.offset(); }
+    SyncClock::time_point offset_reference() const { return estimator.reference(); }
+    double drift() const { return estimator.drift(); }
+
+    // Returns the counts of datagrams dropped so far.
+    const Drops &drops() const { return dropped; }
+
+    int synchronization() const { return level; }
+    bool is_leader() const { return leader; }
+    const PeerTable &peer_table() const { return membership.active(); }
+    const Membership &view() const { return membership; }
+
+private:
+    // A sync source, current or being synchronized to.
+    struct Source {
+        bool does_exist = false;
+        Endpoint peer;
+        int synchronization = 255;
+        SyncClock::time_point last_heard{};
+
+        // Returns true if addr is this source's address and port.
+        bool is(const Endpoint &addr) const {
+            return peer == addr;
+        }
+    };
+
+    // The best candidate of the current election that this node knows of.
+    struct Ballot {
+        Endpoint candidate;
+        uint64_t accuracy = UNKNOWN_ACCURACY;
+        SyncClock::time_point until = SyncClock::time_point::min();
+
+        // Returns true if the given candidate ranks before this one.
+        bool beaten_by(const Endpoint &other, uint64_t other_accuracy) const {
+            return std::tie(other_accuracy, other) < std::tie(accuracy, candidate);
+        }
+    };
+
+    // Checks a datagram's type byte and sender against the flood limits
+    // before it is parsed. Returns false, counting the drop, if it is to be
+    // ignored.
+    bool admissible(const uint8_t *data, size_t len, const Endpoint &sender,
+                    const PeerState *known, SyncClock::time_point received_at);
+
+    // Counts a dropped datagram and prints what, unless too many were
+    // printed lately.
+    void drop(uint64_t &counter, const std::string &what, SyncClock::time_point now);
+
+    // Encodes a Message and sends it; no allocation happens per message.
+    bool send_message(const Message &msg, const Endpoint &dest, const std::string &what);
+
+    // Sends a DELAY_REQUEST to dest and records T3.
+    bool send_delay_request(const Endpoint &dest);
+
+    // Reads the contact list of a HELLO_REPLY or SHUFFLE into contacts.
+    // Returns false if a record is not an IPv4 or IPv6 address with a non-zero port.
+    static bool read_contacts(const MessageView &msg, std::vector<Endpoint> &contacts);
+
+    // Adds sender to the active view, telling an evicted neighbour to leave.
+    // Returns false if the view was full and the admission not forced.
+    bool admit(const Endpoint &sender, bool forced);
+
+    // Sends a FORWARD_JOIN for joiner with the given hops left to dest.
+    bool forward_join(const Endpoint &joiner, uint8_t hops, const Endpoint &dest);
+
+    // SHUFFLEs with a random neighbour and repairs the active view.
+    void maintain_membership();
+
+    // Picks the peers that get this round's SYNC_START when the fan-out is
+    // limited, and fills offers with their addresses by precision.
+    void select_offers(SyncClock::time_point now);
+
+    // Makes this node the leader; its first SYNC_START round goes out after
+    // first_round.
+    void lead(SyncClock::time_point now, std::chrono::nanoseconds first_round);
+
+    // Runs for leader with the given clock error, unless a better candidate
+    // is already known.
+    void stand_for_leader(SyncClock::time_point now, uint64_t accuracy_ns);
+
+    // Sends an ELECTION naming candidate to dest.
+    bool send_election(const Endpoint &candidate, uint64_t accuracy_ns, uint8_t kind,
+                       const Endpoint &dest);
+
+    // Sends the ballot's candidate to every gossip neighbour but except.
+    void flood_ballot(const Endpoint &except);
+
+    void on_hello(const Endpoint &sender);
+    void on_hello_reply(const Endpoint &sender);
+    void on_connect(const Endpoint &sender);
+    void on_ack_connect(const Endpoint &sender);
+    void on_disconnect(const Endpoint &sender);
+    void on_shuffle(const Endpoint &sender);
+    void on_shuffle_reply();
+    void on_forward_join(const Endpoint &sender);
+    void on_sync_start(const Endpoint &sender, PeerState *known, SyncClock::time_point received_at);
+    void on_delay_request(const Endpoint &sender, PeerState *known, SyncClock::time_point received_at);
+    void on_delay_response(const Endpoint &sender);
+    void on_leader();
+    void on_election(const Endpoint &sender);
+    void on_get_time(const Endpoint &sender);
+
+    Transport &transport;
+    Clock &clock;
+    const Endpoint self_addr;
+    const std::optional<Endpoint> contact;
+
+    // Neighbours, which get SYNC_START, and other known members.
+    Membership membership;
+    const size_t max_children;
+    std::vector<Endpoint> offers[2];  // This round's SYNC_START targets, by Precision.
+    SyncClock::time_point last_shuffle;
+
+    // T1-T4, the offset and its accuracy are kept in nanoseconds of the
+    // SyncClock whatever precision a peer exchanges timestamps in. The
+    // offset itself lives in the estimator, as it changes with time.
+    int level = 255;
+    SyncClock::time_point start_time;
+    SyncClock::time_point last_start;
+    std::chrono::nanoseconds accuracy{0};
+    std::chrono::nanoseconds T1{0}, T2{0}, T3{0}, T4{0};
+    OffsetEstimator estimator;          // Filters the samples of the current source.
+    int exchanges_left = 0;             // DELAY_REQUESTs still to send this round.
+    bool leader = false;
+
+    // Election state.
+    const bool electable;
+    Ballot ballot;
+    SyncClock::time_point candidacy_ends = SyncClock::time_point::max();
+
+    // Current sync source and ongoing sync target.
+    Source synchronized_to, synchronizing_to;
+
+    // Flood limits and what they dropped.
+    RateLimiter time_limiter;
+    RateLimiter request_limiter;
+    TokenBucket drop_log;
+    Drops dropped;
+
+    // The datagram being handled; valid during on_datagram().
+    MessageView recvMsg;
+
+    std::vector<uint8_t> send_buf;      // Scratch space for encoded messages.
+    SyncStartTemplate sync_start;
+    SyncStartTemplate sync_start_ns;
+};
+
+#endif // SYNC_NODE_H
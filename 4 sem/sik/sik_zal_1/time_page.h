@@ -0,0 +1,125 @@
+#ifndef TIME_PAGE_H
+#define TIME_PAGE_H
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "sync_clock.h"
+
+// The time page lets processes on the node's host read synchronized time
+// without a GET_TIME round trip. peer-time-sync -s NAME publishes its clock
+// parameters in the POSIX shared memory object NAME (see TimePublisher), and
+// a reader computes the same reading TIME would carry from one
+// CLOCK_MONOTONIC_RAW read through the vDSO, with no system call.
+//
+// This header is the whole client library; it needs only sync_clock.h.
+//
+//     auto page = TimePageReader::open("/peer-time-sync");
+//     TimeReading t;
+//     if (page && page->read(t) && t.level < 254) use(t.time);
+
+// Layout of the shared page. The parameters are guarded by a seqlock: the
+// writer makes sequence odd, stores them and makes it even again; a reader
+// retries while sequence is odd or changed during its loads. Every field is
+// an atomic, so readers racing the writer read stale values, never torn ones.
+struct TimePage {
+    static constexpr uint32_t MAGIC = 0x50545332;   // "PTS2"
+
+    std::atomic<uint32_t> magic;
+    std::atomic<uint32_t> sequence;
+    std::atomic<int64_t> start_ns;      // start_time, in SyncClock nanoseconds.
+    std::atomic<int64_t> offset_ns;     // The node's offset to its source at reference_ns,
+    std::atomic<int64_t> reference_ns;  // a SyncClock time,
+    std::atomic<double> drift;          // changing by drift ns per ns from then on.
+    std::atomic<uint64_t> accuracy_ns;  // As reported in TIME; UINT64_MAX if unknown.
+    std::atomic<uint32_t> level;        // Synchronization level.
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<double>::is_always_lock_free,
+              "the time page needs lock-free 64-bit atomics");
+
+// Size of the shared memory object.
+constexpr size_t TIME_PAGE_SIZE = 4096;
+
+// One synchronized time reading, as a TIME message would report it.
+struct TimeReading {
+    std::chrono::nanoseconds time{0};
+    uint8_t level = 255;
+    uint64_t accuracy_ns = 0;
+};
+
+// The TimePageReader class maps a node's time page read-only.
+class TimePageReader {
+public:
+    // Maps the page published under name. Returns nothing if there is no
+    // such page or it was not written by peer-time-sync.
+    static std::optional<TimePageReader> open(const std::string &name) {
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0) return std::nullopt;
+        void *addr = mmap(nullptr, TIME_PAGE_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED) return std::nullopt;
+        TimePageReader reader(static_cast<const TimePage *>(addr));
+        if (reader.page->magic.load(std::memory_order_acquire) != TimePage::MAGIC) {
+            return std::nullopt;
+        }
+        return reader;
+    }
+
+    TimePageReader(TimePageReader &&other) noexcept : page(std::exchange(other.page, nullptr)) {}
+    TimePageReader &operator=(TimePageReader &&other) noexcept {
+        std::swap(page, other.page);
+        return *this;
+    }
+    TimePageReader(const TimePageReader &) = delete;
+    TimePageReader &operator=(const TimePageReader &) = delete;
+
+    ~TimePageReader() {
+        if (page) munmap(const_cast<TimePage *>(page), TIME_PAGE_SIZE);
+    }
+
+    // Reads the synchronized time now. Returns false only if the writer kept
+    // the page busy for every attempt, which takes a writer updating it
+    // continuously.
+    bool read(TimeReading &out) const {
+        for (int attempt = 0; attempt < 1000; ++attempt) {
+            uint32_t before = page->sequence.load(std::memory_order_acquire);
+            if (before & 1) continue;
+            int64_t start = page->start_ns.load(std::memory_order_relaxed);
+            int64_t offset = page->offset_ns.load(std::memory_order_relaxed);
+            int64_t reference = page->reference_ns.load(std::memory_order_relaxed);
+            double drift = page->drift.load(std::memory_order_relaxed);
+            uint64_t accuracy = page->accuracy_ns.load(std::memory_order_relaxed);
+            uint32_t level = page->level.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (page->sequence.load(std::memory_order_relaxed) != before) continue;
+
+            // The same reading as clock_reading(): a leader and an
+            // unsynchronized node report their own clock.
+            auto now = SyncClock::now().time_since_epoch();
+            int64_t base = 0;
+            if (level != 0 && level != 255) {
+                base = offset + std::llround(drift * static_cast<double>(now.count() - reference));
+            }
+            out.time = now - std::chrono::nanoseconds(start + base);
+            out.level = static_cast<uint8_t>(level);
+            out.accuracy_ns = accuracy;
+            return true;
+        }
+        return false;
+    }
+
+private:
+    explicit TimePageReader(const TimePage *mapped) : page(mapped) {}
+
+    const TimePage *page;
+};
+
+#endif // TIME_PAGE_H
@@ -0,0 +1,51 @@
+#include "time_publisher.h"
+#include "err.h"
+#include "message.h"
+
+using namespace std;
+
+TimePublisher::TimePublisher(const string &name) {
+    int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd < 0) syserr("shm_open");
+    if (ftruncate(fd, static_cast<off_t>(TIME_PAGE_SIZE)) < 0) syserr("ftruncate");
+    void *addr = mmap(nullptr, TIME_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) syserr("mmap");
+    page = static_cast<TimePage *>(addr);
+
+    // A page left behind by an earlier run keeps its sequence, so readers
+    // that still map it see the new parameters as one more update.
+    publish(255, SyncClock::time_point{}, chrono::nanoseconds(0), SyncClock::time_point{}, 0,
+            UNKNOWN_ACCURACY);
+    page->magic.store(TimePage::MAGIC, memory_order_release);
+}
+
+TimePublisher::~TimePublisher() {
+    munmap(page, TIME_PAGE_SIZE);
+}
+
+void TimePublisher::publish(int level, SyncClock::time_point start_time,
+                            chrono::nanoseconds offset, SyncClock::time_point reference,
+                            double drift, uint64_t accuracy_ns) {
+    int64_t start = start_time.time_since_epoch().count();
+    int64_t ref = reference.time_since_epoch().count();
+    auto lvl = static_cast<uint32_t>(level);
+    if (page->level.load(memory_order_relaxed) == lvl &&
+        page->start_ns.load(memory_order_relaxed) == start &&
+        page->offset_ns.load(memory_order_relaxed) == offset.count() &&
+        page->reference_ns.load(memory_order_relaxed) == ref &&
+        page->drift.load(memory_order_relaxed) == drift &&
+        page->accuracy_ns.load(memory_order_relaxed) == accuracy_ns) {
+        return;
+    }
+    uint32_t seq = page->sequence.load(memory_order_relaxed);
+    page->sequence.store(seq | 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    page->start_ns.store(start, memory_order_relaxed);
+    page->offset_ns.store(offset.count(), memory_order_relaxed);
+    page->reference_ns.store(ref, memory_order_relaxed);
+    page->drift.store(drift, memory_order_relaxed);
+    page->accuracy_ns.store(accuracy_ns, memory_order_relaxed);
+    page->level.store(lvl, memory_order_relaxed);
+    page->sequence.store((seq | 1) + 1, memory_order_release);
+}
@@ -0,0 +1,35 @@
+#ifndef TIME_PUBLISHER_H
+#define TIME_PUBLISHER_H
+
+#include <cstdint>
+#include <chrono>
+#include <string>
+
+#include "time_page.h"
+#include "sync_clock.h"
+
+// The TimePublisher class writes a node's clock parameters to its time page
+// (see time_page.h), where local processes read them without asking the node.
+class TimePublisher {
+public:
+    // Creates or reopens the shared memory object name and maps it. Readers
+    // that mapped it before keep working. Terminates the program on error.
+    explicit TimePublisher(const std::string &name);
+    ~TimePublisher();
+
+    TimePublisher(const TimePublisher &) = delete;
+    TimePublisher &operator=(const TimePublisher &) = delete;
+
+    // Publishes the parameters clock_reading() takes, with the offset given
+    // at reference and changing by drift from then on, and the accuracy. The
+    // page is only written when they changed, so readers' cached copies of
+    // it stay valid between synchronizations.
+    void publish(int level, SyncClock::time_point start_time,
+                 std::chrono::nanoseconds offset, SyncClock::time_point reference,
+                 double drift, uint64_t accuracy_ns);
+
+private:
+    TimePage *page;
+};
+
+#endif // TIME_PUBLISHER_H
@@ -0,0 +1,159 @@
+#pragma once   // Ensure this header is included at most once in each translation unit.
+
+/* --------------------------------------------------------------------------
+ * Standard-library and POSIX headers required for address hashing and the
+ * token-bucket clock.
+ * --------------------------------------------------------------------------*/
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+/* --------------------------------------------------------------------------
+ * The admission namespace decides, right after accept(), whether a new
+ * connection may take a poll slot.  Two independent limits apply: a token
+ * bucket per source address and a global cap on connections that have not
+ * yet sent HELLO.  Rejected sockets are closed before any Player is built.
+ * --------------------------------------------------------------------------*/
+namespace admission {
+
+    using clock = std::chrono::steady_clock;
+
+    /* Decision is the outcome of Controller::admit. */
+    enum class Decision {
+        ADMIT,          // Connection may proceed.
+        RATE_LIMITED,   // Source address exceeded its token bucket.
+        HANDSHAKE_CAP   // Too many connections are still waiting for HELLO.
+    };
+
+    /* ----------------------------------------------------------------------
+     * Address is the 128-bit source address used as the bucket key.  The
+     * listener is dual-stack, so IPv4 peers arrive as IPv4-mapped IPv6 and
+     * share the same key space.
+     * -------------------------------------------------------------------- */
+    struct Address {
+        in6_addr addr;
+
+        bool operator==(const Address& other) const {
+            return std::memcmp(&addr, &other.addr, sizeof(addr)) == 0;
+        }
+    };
+
+    struct Address_Hash {
+        size_t operator()(const Address& a) const {
+            uint64_t hi, lo;
+            std::memcpy(&hi, a.addr.s6_addr, sizeof(hi));
+            std::memcpy(&lo, a.addr.s6_addr + sizeof(hi), sizeof(lo));
+            return std::hash<uint64_t>()(hi * 0x9E3779B97F4A7C15ULL ^ lo);
+        }
+    };
+
+    // to_address extracts the key from an accept() peer address.
+    inline Address to_address(const sockaddr_storage& peer) {
+        Address a{};
+        if (peer.ss_family == AF_INET6) {
+            a.addr = reinterpret_cast<const sockaddr_in6*>(&peer)->sin6_addr;
+        } else if (peer.ss_family == AF_INET) {
+            // Store as ::ffff:a.b.c.d to match what the dual-stack socket reports.
+            a.addr.s6_addr[10] = 0xff;
+            a.addr.s6_addr[11] = 0xff;
+            std::memcpy(a.addr.s6_addr + 12,
+                        &reinterpret_cast<const sockaddr_in*>(&peer)->sin_addr, 4);
+        }
+        return a;
+    }
+
+    /* Bucket holds the tokens left for one address and when it was refilled. */
+    struct Bucket {
+        double            tokens;
+        clock::time_point refilled;
+    };
+
+    /* ----------------------------------------------------------------------
+     * Controller owns the buckets and the rejection counters.  A rate of 0
+     * disables per-address limiting and a cap of 0 disables the handshake
+     * cap, so the default configuration admits everything as before.
+     * -------------------------------------------------------------------- */
+    class Controller {
+    private:
+        double rate;            // Tokens added per second for each address.
+        double burst;           // Bucket capacity.
+        size_t handshake_cap;   // Maximum connections without HELLO, 0 = unlimited.
+
+        std::unordered_map<Address, Bucket, Address_Hash> buckets;
+
+        uint64_t admitted_count      = 0;
+        uint64_t rate_limited_count  = 0;
+        uint64_t cap_rejected_count  = 0;
+
+    public:
+        Controller(double rate_per_s, double burst_size, size_t max_pending)
+            : rate(rate_per_s),
+              burst(burst_size > 0 ? burst_size : (rate_per_s > 1 ? rate_per_s : 1)),
+              handshake_cap(max_pending) {}
+
+        /* admit applies both limits to a connection from peer.  pending is
+         * the number of accepted connections still waiting for HELLO.  The
+         * handshake cap is checked first so a saturated server does not
+         * charge tokens for connections it would drop anyway. */
+        Decision admit(const sockaddr_storage& peer, size_t pending, clock::time_point now) {
+            if (handshake_cap > 0 && pending >= handshake_cap) {
+                ++cap_rejected_count;
+                return Decision::HANDSHAKE_CAP;
+            }
+            if (rate > 0) {
+                auto [it, inserted] = buckets.try_emplace(to_address(peer), Bucket{ burst, now });
+                Bucket& b = it->second;
+                if (!inserted) {
+                    std::chrono::duration<double> elapsed = now - b.refilled;
+                    b.tokens = std::min(burst, b.tokens + elapsed.count() * rate);
+                    b.refilled = now;
+                }
+                if (b.tokens < 1.0) {
+                    ++rate_limited_count;
+                    return Decision::RATE_LIMITED;
+                }
+                b.tokens -= 1.0;
+            }
+            ++admitted_count;
+            return Decision::ADMIT;
+        }
+
+        /* prune forgets addresses whose bucket has refilled completely; such a
+         * bucket is indistinguishable from a fresh one.  Call it periodically
+         * so one-off visitors do not grow the table without bound. */
+        void prune(clock::time_point now) {
+            if (rate <= 0) return;
+            for (auto it = buckets.begin(); it != buckets.end(); ) {
+                std::chrono::duration<double> elapsed = now - it->second.refilled;
+                if (it->second.tokens + elapsed.count() * rate >= burst) {
+                    it = buckets.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+
+        bool enabled() const {
+            return rate > 0 || handshake_cap > 0;
+        }
+
+        uint64_t admitted() const     { return admitted_count; }
+        uint64_t rate_limited() const { return rate_limited_count; }
+        uint64_t cap_rejected() const { return cap_rejected_count; }
+        size_t   tracked() const      { return buckets.size(); }
+
+        // print_stats writes the counters in the server's log format.
+        void print_stats(std::ostream& out) const {
+            out << "ADMISSION: admitted " << admitted_count
+                << " rate_limited " << rate_limited_count
+                << " handshake_cap " << cap_rejected_count
+                << " tracked_addresses " << buckets.size() << "\r\n";
+        }
+    };
+
+} // namespace admission
@@ -2,6 +2,9 @@
 // file-descriptor utilities, networking primitives, and system calls.
 #include <vector>
 #include <list>
+#include <queue>
+#include <functional>
+#include <algorithm>
 #include <unordered_map>
 #include <string>
 #include <iostream>
@@ -10,12 +13,15 @@
 #include <cerrno>
 #include <cstring>
 #include <csignal>
+#include <memory>
 #include <poll.h>
+#include <sched.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <inttypes.h>
 #include <endian.h>
@@ -27,6 +33,10 @@
 // common helpers shared between client and server.
 #include "message.hpp"
 #include "player.hpp"
+#include "coeff_prefetcher.hpp"
+#include "admission.hpp"
+#include "score_log.hpp"
+#include "fixed.hpp"
 #include "common.hpp"
 #include "err.h"
 
@@ -47,16 +57,70 @@ namespace global {
     int n = 4;                  // Degree of the secret polynomial.
     int m = 131;                // Threshold on cumulative “m” after which the game ends.
     std::string filename = "";  // Path to the coefficient file.
+    common::ServerTuning tuning; // Optional busy-poll and CPU pinning settings.
 
     // Dynamic game state that evolves while the program is running.
     int current_m = 0;          // Current total of m contributed by all players.
     bool finish = false;        // True once SCORING is sent and the game is over.
+    volatile sig_atomic_t interrupted = 0;  // Set by SIGINT; the reactor then shuts down.
     size_t active_clients = 0;  // Count of connected sockets that are still alive.
 
     // Containers holding objects that represent connected players and helpers
     // that track arrivals requiring special handling.
     std::unordered_map<int, player::Player> players_map;
-    std::list<int> just_connected;
+
+    // Connection records the poll slot of every live descriptor and a
+    // connection id that is never reused, unlike the descriptor itself.
+    struct Connection {
+        int      slot;
+        uint64_t id;
+    };
+    std::unordered_map<int, Connection> connections;   // fd -> slot and id.
+    std::vector<int> free_slots;                        // Unused poll slots, a min-heap.
+    uint64_t next_connection_id = 0;
+    size_t pending_hellos = 0;                          // Accepted connections without HELLO.
+
+    // Per-address rate limiting and the HELLO handshake cap; built from
+    // tuning once the command line is parsed.
+    admission::Controller admission{0, 0, 0};
+
+    // Hello_Deadline is one pending HELLO expiry.  The min-heap below is
+    // ordered by deadline, so each iteration only looks at expired entries;
+    // stale entries (closed or already greeted connections) are dropped lazily.
+    struct Hello_Deadline {
+        std::chrono::steady_clock::time_point deadline;
+        uint64_t connection_id;
+        int      fd;
+
+        bool operator>(const Hello_Deadline& other) const {
+            return deadline > other.deadline;
+        }
+    };
+    std::priority_queue<
+        Hello_Deadline,
+        std::vector<Hello_Deadline>,
+        std::greater<Hello_Deadline>
+    > hello_deadlines;
+
+    // Busy-poll statistics: spins that found ready descriptors versus spin
+    // budgets that ran out and fell back to a blocking poll().
+    uint64_t busy_poll_hits = 0;
+    uint64_t busy_poll_fallbacks = 0;
+
+    // One past the highest poll slot in use; the busy-poll spin scans only
+    // the slots below it.
+    nfds_t poll_limit = 1;
+
+    // Per-option counters for the socket options applied at accept time.
+    struct Socket_Option_Stats {
+        const char* name;
+        uint64_t    applied = 0;
+        uint64_t    failed  = 0;
+    };
+    Socket_Option_Stats nodelay_stats{"TCP_NODELAY"};
+    Socket_Option_Stats sndbuf_stats{"SO_SNDBUF"};
+    Socket_Option_Stats rcvbuf_stats{"SO_RCVBUF"};
+    Socket_Option_Stats lowat_stats{"TCP_NOTSENT_LOWAT"};
 
     // next_tick records when the next one-second timer event should fire.
     auto next_tick = std::chrono::steady_clock::now() + std::chrono::seconds(1);
@@ -71,68 +135,166 @@ void disconnect_client(int index, pollfd poll_descriptors[], std::unordered_map<
     close(fd);
     auto it = players_map.find(fd);
     if (it != players_map.end()) {
+        if (!it->second.get_received_hello()) --global::pending_hellos;
         global::current_m -= it->second.get_m();
         players_map.erase(it);
     }
     poll_descriptors[index].fd      = -1;
     poll_descriptors[index].events  = 0;
     poll_descriptors[index].revents = 0;
+    global::connections.erase(fd);
+    global::free_slots.push_back(index);
+    std::push_heap(global::free_slots.begin(), global::free_slots.end(), std::greater<>());
+    while (global::poll_limit > 1 && poll_descriptors[global::poll_limit - 1].fd == -1) {
+        --global::poll_limit;
+    }
     --global::active_clients;
     printf("Client %d fully disconnected\n", fd);
 }
 
-// get_sorted_players returns two parallel vectors of player IDs and scores
-// sorted lexicographically by player_id so the SCORING message is deterministic.
-std::pair<std::vector<std::string>, std::vector<std::string>> get_sorted_players(const std::unordered_map<int, player::Player>& players_map) {
-    struct Entry {
-        std::string id;
-        double      score;
-    };
+// enable_busy_poll asks the kernel to busy-poll the device queue of fd for up to
+// usec microseconds.  It returns false when the socket options are unavailable
+// (old kernel or missing CAP_NET_ADMIN) so the caller can keep blocking poll().
+bool enable_busy_poll(int fd, int usec) {
+#ifdef SO_BUSY_POLL
+    if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) < 0) {
+        return false;
+    }
+#ifdef SO_PREFER_BUSY_POLL
+    int one = 1;
+    // Preferring busy polling is only a hint; older kernels lack it.
+    setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &one, sizeof(one));
+#endif
+    return true;
+#else
+    (void) fd;
+    (void) usec;
+    return false;
+#endif
+}
+
+// pin_to_cpu binds the calling (reactor) thread to a single CPU.
+bool pin_to_cpu(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+// set_option applies one integer socket option and records the outcome.
+void set_option(int fd, int level, int name, int value, global::Socket_Option_Stats& stats) {
+    if (setsockopt(fd, level, name, &value, sizeof(value)) == 0) {
+        ++stats.applied;
+    } else {
+        ++stats.failed;
+    }
+}
+
+// apply_socket_options configures a freshly accepted client socket according
+// to the tuning flags.  Failures are counted but never reject the client.
+void apply_socket_options(int fd) {
+    if (global::tuning.tcp_nodelay) {
+        set_option(fd, IPPROTO_TCP, TCP_NODELAY, 1, global::nodelay_stats);
+    }
+    if (global::tuning.sndbuf > 0) {
+        set_option(fd, SOL_SOCKET, SO_SNDBUF, global::tuning.sndbuf, global::sndbuf_stats);
+    }
+    if (global::tuning.rcvbuf > 0) {
+        set_option(fd, SOL_SOCKET, SO_RCVBUF, global::tuning.rcvbuf, global::rcvbuf_stats);
+    }
+#ifdef TCP_NOTSENT_LOWAT
+    if (global::tuning.notsent_lowat > 0) {
+        set_option(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, global::tuning.notsent_lowat, global::lowat_stats);
+    }
+#endif
+}
+
+// print_socket_option_stats reports how many clients got each option.
+void print_socket_option_stats() {
+    for (const auto* stats : { &global::nodelay_stats, &global::sndbuf_stats,
+                               &global::rcvbuf_stats, &global::lowat_stats }) {
+        if (stats->applied == 0 && stats->failed == 0) continue;
+        std::cout << "SOCKOPT " << stats->name
+                  << " APPLIED: " << stats->applied
+                  << " FAILED: " << stats->failed << "\r\n";
+    }
+}
+
+// reactor_poll waits for descriptor events.  In busy-poll mode it first spins
+// with non-blocking poll() calls for the configured budget and only then falls
+// back to the regular blocking wait with TIMEOUT.  The spin covers only the
+// listener and the slots up to poll_limit, which the lowest-first slot reuse
+// keeps close to the number of live connections, so a spin iteration does
+// not walk the whole CONNECTIONS-sized array.
+int reactor_poll(pollfd poll_descriptors[], nfds_t count) {
+    if (global::tuning.busy_poll_us > 0) {
+        auto spin_end = std::chrono::steady_clock::now() + std::chrono::microseconds(global::tuning.busy_poll_us);
+        nfds_t spin_count = std::min(count, global::poll_limit);
+        do {
+            int ready = poll(poll_descriptors, spin_count, 0);
+            if (ready != 0) {
+                if (ready > 0) ++global::busy_poll_hits;
+                return ready;
+            }
+        } while (std::chrono::steady_clock::now() < spin_end);
+        ++global::busy_poll_fallbacks;
+    }
+    return poll(poll_descriptors, count, TIMEOUT);
+}
 
-    std::vector<Entry> entries;
-    entries.reserve(players_map.size());
+// get_results returns every player's ID and final score, sorted
+// lexicographically by player_id so the SCORING message is deterministic.
+// The score log ranks its own copy by score.
+std::vector<score_log::Result> get_results(const std::unordered_map<int, player::Player>& players_map) {
+    std::vector<score_log::Result> results;
+    results.reserve(players_map.size());
 
     for (const auto& kv : players_map) {
         const player::Player& pl = kv.second;
-        entries.push_back({ pl.get_player_id(), pl.calculate_score() });
+        results.push_back({ pl.get_player_id(), pl.calculate_score() });
     }
 
-    std::sort(entries.begin(), entries.end(),
+    std::sort(results.begin(), results.end(),
         [](auto const& a, auto const& b) {
-            return a.id < b.id;
+            return a.player < b.player;
         }
     );
-
-    std::vector<std::string> ids;
-    std::vector<std::string> scores;
-    ids.reserve(entries.size());
-    scores.reserve(entries.size());
-
-    for (auto const& e : entries) {
-        ids.push_back(e.id);
-        scores.push_back(common::to_rational(e.score));
-    }
-
-    return { std::move(ids), std::move(scores) };
+    return results;
 }
 
 // -----------------------------------------------------------------------------
 // Program entry point.
 // -----------------------------------------------------------------------------
 int main(int argc, char *argv[]) {
-    // Install basic signal handlers so Ctrl-C exits quickly and SIGPIPE is ignored.
-    std::signal(SIGINT, [](int){ _exit(0); });
+    // Install basic signal handlers: Ctrl-C stops the reactor within one poll
+    // timeout, so main returns and the score log writes out queued games.
+    // SIGPIPE is ignored.
+    std::signal(SIGINT, [](int){ global::interrupted = 1; });
     std::signal(SIGPIPE, SIG_IGN); 
 
     // Parse command-line arguments and verify that they satisfy assignment rules.
-    common::parse_server_arguments(argc, argv, global::port, global::k, global::n, global::m, global::filename);
+    common::parse_server_arguments(argc, argv, global::port, global::k, global::n, global::m, global::filename, global::tuning);
     common::verify_server_input(global::port, global::k, global::n, global::m, global::filename);
-    std::ifstream file(global::filename);
-    if (!file.is_open()) {
+    global::admission = admission::Controller(global::tuning.accept_rate, global::tuning.accept_burst,
+                                              static_cast<size_t>(global::tuning.max_pending));
+    // The prefetcher reads and parses the coefficient file on its own thread,
+    // so HELLO handling below only pops ready-made COEFF records.
+    coeff::Prefetcher coeffs(global::filename);
+    if (!coeffs.is_open()) {
         fatal("Nie udało się otworzyć pliku");
         return 1;
     }
 
+    // Finished games go to the score log on its own writer thread, so the
+    // reactor only queues them.
+    std::unique_ptr<score_log::Writer> score_writer;
+    if (!global::tuning.score_log.empty()) {
+        score_writer = std::make_unique<score_log::Writer>(global::tuning.score_log);
+        if (!score_writer->is_open()) {
+            fatal("cannot open score log " + global::tuning.score_log);
+        }
+    }
+
     // ----------------------------------------------------------------------
     // Socket setup: create an IPv6 listening socket that also accepts IPv4
     // connections through the IPv4-mapped IPv6 mechanism.
@@ -168,6 +330,16 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    // Optional low-latency mode: busy polling and a dedicated CPU.  Both are
+    // best effort; when unavailable the server keeps the blocking reactor.
+    if (global::tuning.busy_poll_us > 0 && !enable_busy_poll(socket_fd, global::tuning.busy_poll_us)) {
+        std::cerr << "WARNING: busy polling unavailable, using blocking poll \r\n";
+        global::tuning.busy_poll_us = 0;
+    }
+    if (global::tuning.pin_cpu >= 0 && !pin_to_cpu(global::tuning.pin_cpu)) {
+        std::cerr << "WARNING: cannot pin reactor to CPU " << global::tuning.pin_cpu << " \r\n";
+    }
+
     // ----------------------------------------------------------------------
     // Prepare the pollfd array: slot 0 is the listening socket, remaining
     // slots will be filled dynamically as clients connect.
@@ -178,7 +350,15 @@ int main(int argc, char *argv[]) {
     for (int i = 1; i < CONNECTIONS; ++i) {
         poll_descriptors[i].fd = -1;
         poll_descriptors[i].events = POLLIN;
+        poll_descriptors[i].revents = 0;
     }
+    // Slots are reused lowest first, so live connections stay packed at the
+    // front of the poll array.
+    global::free_slots.reserve(CONNECTIONS);
+    for (int i = 1; i < CONNECTIONS; ++i) {
+        global::free_slots.push_back(i);
+    }
+    std::make_heap(global::free_slots.begin(), global::free_slots.end(), std::greater<>());
 
     static char buffer[BUFFER_SIZE]; // Shared scratch buffer for recv().
     sockaddr_storage cli_addr; // Holds the peer’s address on accept().
@@ -206,15 +386,23 @@ int main(int argc, char *argv[]) {
                     poll_descriptors[i].events |= POLLOUT;
                 }
             }
+            global::admission.prune(now);
             global::next_tick = std::chrono::steady_clock::now() + std::chrono::seconds(1);
         }
 
         // -------------------------------------------------- Check win condition.
         if (global::current_m >= global::m) {
-            std::pair<std::vector<std::string>, std::vector<std::string>> res = get_sorted_players(global::players_map);
-            std::vector<std::string> player_id = res.first;
-            std::vector<std::string> player_scores = res.second;
+            std::vector<score_log::Result> results = get_results(global::players_map);
+            std::vector<std::string> player_id;
+            std::vector<std::string> player_scores;
+            for (const auto& r : results) {
+                player_id.push_back(r.player);
+                player_scores.push_back(fixed::to_string(r.score));
+            }
             std::string msg = message::SCORING_msg(player_id, player_scores);
+            if (score_writer && !global::finish) {
+                score_writer->submit(std::move(results));
+            }
             global::finish = true;
             for (int i = 1; i < CONNECTIONS; ++i) {
                 int fd = poll_descriptors[i].fd;
@@ -233,8 +421,12 @@ int main(int argc, char *argv[]) {
         }
 
         // -------------------------------------------------- Wait for descriptors to change state.
-        int poll_status = poll(poll_descriptors, CONNECTIONS, TIMEOUT);
-        if (poll_status == -1 ) {
+        int poll_status = reactor_poll(poll_descriptors, CONNECTIONS);
+        if (global::interrupted) {
+            break;
+        } else if (poll_status == -1 && errno == EINTR) {
+            continue;
+        } else if (poll_status == -1 ) {
             std::cerr << "ERROR: unkown error \r\n";
             close(socket_fd);
             return 1;
@@ -253,6 +445,10 @@ int main(int argc, char *argv[]) {
                                     &cli_len);
                 if (client_fd < 0) {
                    std::cerr << "ERROR: couldn't accept new client \r\n";
+                } else if (global::admission.admit(cli_addr, global::pending_hellos, std::chrono::steady_clock::now()) != admission::Decision::ADMIT) {
+                    // Rejected before any per-client setup; the counters are
+                    // reported at game end instead of logging every drop.
+                    close(client_fd);
                 } else {
                     // Convert the socket to non-blocking mode.
                     int flags = fcntl(client_fd, F_GETFL, 0);
@@ -263,18 +459,22 @@ int main(int argc, char *argv[]) {
                         std::cerr << "ERROR:  system error \r\n";
                         close(client_fd);
                     }
-                     // Find an empty slot in the poll array.
+                    apply_socket_options(client_fd);
+                    if (global::tuning.busy_poll_us > 0) {
+                        enable_busy_poll(client_fd, global::tuning.busy_poll_us);
+                    }
+                    // Take the lowest free slot in the poll array.
                     bool accepted = false;
-                    int slot;
-                    for (int i = 1; i < CONNECTIONS; ++i) {
-                        if (poll_descriptors[i].fd == -1) {
-                            poll_descriptors[i].fd     = client_fd;
-                            poll_descriptors[i].events = POLLIN;
-                            global::active_clients++;
-                            accepted = true;
-                            slot = i;
-                            break;
-                        }
+                    int slot = -1;
+                    if (!global::free_slots.empty()) {
+                        std::pop_heap(global::free_slots.begin(), global::free_slots.end(), std::greater<>());
+                        slot = global::free_slots.back();
+                        global::free_slots.pop_back();
+                        poll_descriptors[slot].fd     = client_fd;
+                        poll_descriptors[slot].events = POLLIN;
+                        global::poll_limit = std::max(global::poll_limit, static_cast<nfds_t>(slot) + 1);
+                        global::active_clients++;
+                        accepted = true;
                     }
                     if (!accepted) {
                         close(client_fd);
@@ -301,8 +501,11 @@ int main(int argc, char *argv[]) {
                         }
                         
                         // Create a Player object for this descriptor.
-                        global::players_map.emplace(client_fd, player::Player(global::n, global::k, global::m, ip, port));
-                        global::just_connected.push_back(client_fd);
+                        auto pl_it = global::players_map.emplace(client_fd, player::Player(global::n, global::k, global::m, ip, port)).first;
+                        uint64_t connection_id = global::next_connection_id++;
+                        global::connections[client_fd] = { slot, connection_id };
+                        global::hello_deadlines.push({ pl_it->second.get_expiration_date(), connection_id, client_fd });
+                        ++global::pending_hellos;
                         // If the game has already finished, close the client immediately.
                         if (global::finish) {
                             disconnect_client(slot, poll_descriptors, global::players_map);
@@ -335,8 +538,12 @@ int main(int argc, char *argv[]) {
                     if (n > 0 && !global::finish) {
                         // ► normalny odczyt danych
                         bool send_message = false;
+                        bool was_pending = !pl.get_received_hello();
                         pl.push_received_buffer(std::vector<char>(buffer, buffer + n));
-                        pl.process_received_buffer(file, send_message, global::current_m, global::finish);
+                        pl.process_received_buffer(coeffs, send_message, global::current_m, global::finish);
+                        if (was_pending && pl.get_received_hello()) {
+                            --global::pending_hellos;
+                        }
                         if (send_message) {
                             poll_descriptors[i].events |= POLLOUT;
                         }
@@ -350,10 +557,20 @@ int main(int argc, char *argv[]) {
                 
                 // -------------------- Write side: drain pending responses.
                 if (poll_descriptors[i].revents & POLLOUT) {
+                    // With TCP_NOTSENT_LOWAT the kernel signals POLLOUT only once its
+                    // unsent backlog is small, so a larger low-water mark may take a
+                    // larger chunk.  A small one never shrinks it below CHUNK_SIZE,
+                    // which would cap throughput at one tiny send per wakeup.
+                    size_t chunk = CHUNK_SIZE;
+#ifdef TCP_NOTSENT_LOWAT
+                    if (global::tuning.notsent_lowat > 0) {
+                        chunk = std::max(static_cast<size_t>(global::tuning.notsent_lowat), chunk);
+                    }
+#endif
                     std::vector<char> tmp;
-                    tmp.reserve(std::min<size_t>(pl.send_buffer.size(), CHUNK_SIZE));
+                    tmp.reserve(std::min<size_t>(pl.send_buffer.size(), chunk));
                     auto tmp2 = pl.send_buffer.begin();
-                    for (size_t cnt = 0; cnt < CHUNK_SIZE && tmp2 != pl.send_buffer.end(); ++cnt, ++tmp2) {
+                    for (size_t cnt = 0; cnt < chunk && tmp2 != pl.send_buffer.end(); ++cnt, ++tmp2) {
                         tmp.push_back(*tmp2);
                     }
                     ssize_t n = send(fd, tmp.data(), tmp.size(), 0);
@@ -395,47 +612,48 @@ int main(int argc, char *argv[]) {
             }
         }
         // -------------------------------------------------- Enforce HELLO time-outs for newcomers.
-        auto jt = global::just_connected.begin();
-        while (jt != global::just_connected.end()) {
-            int fd = *jt;
-            int slot = -1;
-            for (int i = 1; i < CONNECTIONS; ++i) {
-                if (poll_descriptors[i].fd == fd) {
-                    slot = i;
-                    break;
-                }
+        auto hello_now = player::time_source::now();
+        while (!global::hello_deadlines.empty() && hello_now > global::hello_deadlines.top().deadline) {
+            global::Hello_Deadline expired = global::hello_deadlines.top();
+            global::hello_deadlines.pop();
+
+            auto conn_it = global::connections.find(expired.fd);
+            if (conn_it == global::connections.end() || conn_it->second.id != expired.connection_id) {
+                continue;   // The connection is gone; its descriptor may be reused.
             }
-            auto map_it = global::players_map.find(fd);
-            if (map_it == global::players_map.end() || slot < 0) {
-                jt = global::just_connected.erase(jt);
-                continue;
-            }
-
-            player::Player& pl = map_it->second;
-            if (!pl.get_received_hello() && pl.expired()) {
-                disconnect_client(slot, poll_descriptors, global::players_map);
-                jt = global::just_connected.erase(jt);
-            }
-            else if (pl.get_received_hello()) {
-                jt = global::just_connected.erase(jt);
-            }
-            else {
-                ++jt;
+            auto map_it = global::players_map.find(expired.fd);
+            if (map_it != global::players_map.end() && !map_it->second.get_received_hello()) {
+                disconnect_client(conn_it->second.slot, poll_descriptors, global::players_map);
             }
         }
         // -------------------------------------------------- Reset state when the round ends.
         if (global::finish && global::active_clients == 0) {
             std::cout << "GAME HAS ENDED \r\n";
+            std::cout << "COEFF QUEUE STALLS: " << coeffs.stalls() << "\r\n";
+            print_socket_option_stats();
+            if (score_writer) {
+                std::cout << "SCORE LOG: queued " << score_writer->submitted()
+                          << " written " << score_writer->written()
+                          << " failed " << score_writer->failed() << "\r\n";
+            }
+            if (global::admission.enabled()) {
+                global::admission.print_stats(std::cout);
+            }
+            if (global::tuning.busy_poll_us > 0) {
+                std::cout << "BUSY POLL HITS: " << global::busy_poll_hits
+                          << " FALLBACKS: " << global::busy_poll_fallbacks << "\r\n";
+            }
             sleep(1);                       // Give the OS time to flush logs.
             global::finish = false;
             global::players_map.clear();
             global::current_m = 0;
-            global::just_connected.clear();
+            global::hello_deadlines = {};
+            global::pending_hellos = 0;
             global::active_clients = 0;
             std::cout << "NEW GAME \r\n";
         }
     } while(true);
-    // This line is theoretically unreachable but cleans up on unusual exits.
+    // Reached on SIGINT; score_writer's destructor flushes the queued games.
     close(socket_fd);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,172 @@
+// Offline micro-benchmark for the game core.  It instantiates many
+// player::Player objects in-process, feeds them synthetic HELLO/PUT lines
+// exactly the way approx-server does after read(), and drives the per-player
+// timers with a fake clock, so no sockets or real waiting are involved.
+//
+// Usage: ./bench-approx [players] [puts_per_k]
+// For every k in {100, 1000, 10000} it prints ns/PUT, allocations/PUT and the
+// peak RSS of the process observed after that run.
+#include <vector>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <atomic>
+#include <new>
+#include <cstdio>
+#include <cstdlib>
+#include <climits>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "player.hpp"
+#include "coeff_prefetcher.hpp"
+#include "common.hpp"
+#include "err.h"
+
+// Every global allocation is counted so that allocations/PUT can be reported.
+namespace counters {
+    std::atomic<size_t> allocations{0};
+}
+
+void* operator new(size_t size) {
+    counters::allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+// The fake clock advanced by the benchmark instead of waiting in real time.
+namespace fake_clock {
+    player::time_source::time_point current = std::chrono::steady_clock::now();
+
+    player::time_source::time_point now() { return current; }
+
+    void advance(std::chrono::seconds s) { current += s; }
+}
+
+// A stream buffer that swallows everything, so the game core's logging does
+// not dominate the measurement.
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+};
+
+// write_coefficients creates a temporary coefficient file holding one COEFF
+// line for every player that is going to send HELLO.
+std::string write_coefficients(int players) {
+    char path[] = "/tmp/bench-approx-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) syserr("mkstemp");
+    close(fd);
+
+    std::ofstream out(path);
+    for (int i = 0; i < players; ++i) {
+        out << "COEFF 1.5 -2 0.25 " << (i % 7) << " 1\r\n";
+    }
+    return path;
+}
+
+// drain_send_buffer emulates a send() that accepted every pending byte and
+// applies the same bookkeeping the server performs after a successful send.
+void drain_send_buffer(player::Player& pl) {
+    int n = static_cast<int>(pl.send_buffer.size());
+    if (n == 0) return;
+    pl.dec_coeff_state_end(n);
+    pl.dec_scoring_end(n);
+    pl.send_buffer.clear();
+    if (pl.get_coeff_state_end() <= 0) {
+        pl.set_put_possible(true);
+    }
+}
+
+long peak_rss_kb() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// run_k plays a synthetic game with the given k and prints one result line.
+void run_k(std::ostream& report, int k, int players, long puts_target) {
+    const int n = 4;
+    std::string path = write_coefficients(players);
+    coeff::Prefetcher coeffs(path);
+    if (!coeffs.is_open()) fatal("cannot open coefficient file");
+
+    std::vector<player::Player> pls;
+    pls.reserve(players);
+    int current_m = 0;
+    bool send_message = false;
+
+    // Handshake phase: every player says HELLO and gets its COEFF.
+    for (int i = 0; i < players; ++i) {
+        pls.emplace_back(n, k, INT_MAX, "127.0.0.1", static_cast<uint16_t>(i));
+        std::string hello = message::HELLO_msg("BOT" + std::to_string(i));
+        pls.back().push_received_buffer(std::vector<char>(hello.begin(), hello.end()));
+        pls.back().process_received_buffer(coeffs, send_message, current_m, false);
+        drain_send_buffer(pls.back());
+    }
+
+    // Pre-build the PUT lines so only the server-side work is measured.
+    std::vector<std::string> puts;
+    for (int i = 0; i <= k && i < 64; ++i) {
+        puts.push_back(message::PUT_msg(std::to_string(i), i % 2 ? "-1.25" : "3.5"));
+    }
+
+    long done = 0;
+    size_t allocations = 0;
+    std::chrono::nanoseconds elapsed{0};
+    while (done < puts_target) {
+        for (int i = 0; i < players && done < puts_target; ++i) {
+            player::Player& pl = pls[i];
+            if (!pl.get_put_possible()) continue;
+            const std::string& line = puts[static_cast<size_t>(done) % puts.size()];
+
+            size_t allocs_before = counters::allocations.load(std::memory_order_relaxed);
+            auto start = std::chrono::steady_clock::now();
+            pl.push_received_buffer(std::vector<char>(line.begin(), line.end()));
+            pl.process_received_buffer(coeffs, send_message, current_m, false);
+            elapsed += std::chrono::steady_clock::now() - start;
+            allocations += counters::allocations.load(std::memory_order_relaxed) - allocs_before;
+            ++done;
+        }
+
+        // One fake second passes: every delayed STATE becomes ready.
+        fake_clock::advance(std::chrono::seconds(1));
+        for (auto& pl : pls) {
+            pl.process_timer_q(send_message);
+            drain_send_buffer(pl);
+        }
+    }
+
+    report << "k=" << k
+           << " players=" << players
+           << " puts=" << done
+           << " ns/PUT=" << (done ? elapsed.count() / done : 0)
+           << " allocs/PUT=" << (done ? static_cast<double>(allocations) / static_cast<double>(done) : 0.0)
+           << " peak_rss_kb=" << peak_rss_kb()
+           << "\n";
+    unlink(path.c_str());
+}
+
+int main(int argc, char *argv[]) {
+    int players = argc > 1 ? std::atoi(argv[1]) : 2000;
+    long puts_per_k = argc > 2 ? std::atol(argv[2]) : 2000000;
+    if (players < 1 || puts_per_k < 1) fatal("usage: bench-approx [players] [puts_per_k]");
+
+    player::time_source::now = fake_clock::now;
+
+    // Silence the game core's per-message logging for the whole run.
+    NullBuffer null_buffer;
+    std::ostream report(std::cout.rdbuf(&null_buffer));
+
+    // Bigger k makes every STATE proportionally larger, so the PUT budget is
+    // scaled down to keep each run in the same ballpark of wall-clock time.
+    for (int k : {100, 1000, 10000}) {
+        run_k(report, k, players, std::max(200L, puts_per_k / k));
+    }
+    std::cout.rdbuf(report.rdbuf());
+    return 0;
+}
@@ -0,0 +1,104 @@
+// Throughput benchmark for the parsers in namespace verification.
+//
+// Usage: ./bench-verification [filter]
+// Every case parses one line repeatedly for at least MIN_TIME and reports
+// iterations, ns per line and MB/s, in the style of Google Benchmark.  Cases
+// cover realistic traffic and adversarial lines such as 10000-entry STATEs,
+// 7-digit fractions and long malformed input.
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "message.hpp"
+#include "fixed.hpp"
+
+namespace bench {
+    constexpr std::chrono::milliseconds MIN_TIME(200);
+
+    // sink keeps the optimiser from discarding the parse results.
+    volatile size_t sink = 0;
+
+    struct Case {
+        std::string name;
+        std::string line;
+        std::function<bool(const std::string&)> parse;
+    };
+
+    void run(const Case& c) {
+        size_t iterations = 0;
+        auto start = std::chrono::steady_clock::now();
+        auto elapsed = std::chrono::steady_clock::duration::zero();
+        for (size_t batch = 1; elapsed < MIN_TIME; batch *= 2) {
+            for (size_t i = 0; i < batch; ++i) {
+                sink = sink + static_cast<size_t>(c.parse(c.line));
+            }
+            iterations += batch;
+            elapsed = std::chrono::steady_clock::now() - start;
+        }
+        double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        double ns_per_line = ns / static_cast<double>(iterations);
+        double mb_per_s = static_cast<double>(c.line.size()) * static_cast<double>(iterations) / ns * 1e3;
+        std::printf("%-32s %12zu %14.1f ns %10.1f MB/s\n", c.name.c_str(), iterations, ns_per_line, mb_per_s);
+    }
+}
+
+// Line generators for the realistic and adversarial inputs.
+std::string state_line(size_t entries, const std::string& value) {
+    std::vector<std::string> values(entries, value);
+    return message::STATE_msg(values);
+}
+
+std::string scoring_line(size_t players) {
+    std::vector<std::string> ids, scores;
+    for (size_t i = 0; i < players; ++i) {
+        ids.push_back("player" + std::to_string(i));
+        scores.push_back(std::to_string(i * 7919) + ".1234567");
+    }
+    return message::SCORING_msg(ids, scores);
+}
+
+int main(int argc, char *argv[]) {
+    std::string filter = argc > 1 ? argv[1] : "";
+
+    std::vector<fixed::Value> states;
+    std::vector<double> reals;
+    std::vector<std::pair<std::string, double>> scores;
+    std::string id;
+    int point = 0;
+    fixed::Value value;
+
+    auto state  = [&](const std::string& m) { return verification::verify_STATE(m, states); };
+    auto coeff  = [&](const std::string& m) { return verification::verify_COEFF(m, states); };
+    auto put    = [&](const std::string& m) { return verification::verify_PUT(m, point, value); };
+    auto hello  = [&](const std::string& m) { return verification::verify_HELLO(m, id); };
+    auto score  = [&](const std::string& m) { return verification::verify_SCORING(m, scores); };
+    auto client_state = [&](const std::string& m) { return verification::verify_STATE(m, reals); };
+
+    std::vector<bench::Case> cases = {
+        { "HELLO/typical",             message::HELLO_msg("Player123"),                 hello },
+        { "PUT/typical",               message::PUT_msg("42", "-1.25"),                 put },
+        { "PUT/7-digit-fraction",      message::PUT_msg("9999", "-4.9999999"),          put },
+        { "COEFF/typical",             "COEFF 1.5 -2 0.25 3 1\r\n",                     coeff },
+        { "COEFF/7-digit-fractions",   "COEFF 1.1234567 -2.7654321 0.0000001 3.3333333 1.9999999 -7.1 8 9\r\n", coeff },
+        { "STATE/k=100",               state_line(101, "12.5"),                         state },
+        { "STATE/k=10000",             state_line(10001, "-3.1415926"),                 state },
+        { "STATE/k=10000/client",      state_line(10001, "-3.1415926"),                 client_state },
+        { "SCORING/1000-players",      scoring_line(1000),                              score },
+        { "bad/STATE-trailing-junk",   state_line(10000, "1.5") + "x\r\n",              state },
+        { "bad/STATE-8-digit-fraction", state_line(10000, "1.5").insert(6, "1.12345678 "), state },
+        { "bad/PUT-long-number",       "PUT 1 " + std::string(100000, '7') + "\r\n",    put },
+        { "bad/PUT-whitespace-flood",  "PUT 1" + std::string(100000, ' ') + "2\r\n",    put },
+        { "bad/HELLO-no-suffix",       "HELLO " + std::string(100000, 'a'),             hello },
+    };
+
+    std::printf("%-32s %12s %17s %15s\n", "case", "iterations", "time/line", "throughput");
+    for (const auto& c : cases) {
+        if (!filter.empty() && c.name.find(filter) == std::string::npos) continue;
+        bench::run(c);
+    }
+    return 0;
+}
@@ -0,0 +1,87 @@
+// Checks that the score log ranks games by score, not by player id.
+//
+// Usage: ./check-score-log
+// Writes a few games to a temporary log with score_log::Writer, reads them
+// back with score_log::scan and compares the order of every game with the
+// expected ranking.  Exits with 1 on the first mismatch.
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "score_log.hpp"
+#include "fixed.hpp"
+
+namespace check {
+    fixed::Score exact(long long units) {
+        fixed::Score s;
+        s.units = units;
+        return s;
+    }
+
+    fixed::Score approx(long double value) {
+        fixed::Score s;
+        s.exact = false;
+        s.approx = value;
+        return s;
+    }
+
+    struct Case {
+        std::string                    name;
+        std::vector<score_log::Result> results;
+        std::vector<std::string>       expected;   // Best first.
+    };
+}
+
+int main() {
+    char dir[] = "/tmp/check-score-log-XXXXXX";
+    if (!mkdtemp(dir)) {
+        std::perror("mkdtemp");
+        return 1;
+    }
+    std::string path = std::string(dir) + "/scores";
+
+    std::vector<check::Case> cases = {
+        { "lower score wins over earlier id",
+          { { "abe", check::exact(50'000'000) }, { "zed", check::exact(20'000'000) } },
+          { "zed", "abe" } },
+        { "ties broken by id",
+          { { "mia", check::exact(10) }, { "ann", check::exact(10) }, { "bob", check::exact(5) } },
+          { "bob", "ann", "mia" } },
+        { "exact and approximate scores compare by value",
+          { { "a", check::approx(3.5L) }, { "b", check::exact(25'000'000) }, { "c", check::approx(1.0L) } },
+          { "c", "b", "a" } },
+    };
+
+    {
+        score_log::Writer writer(path);
+        if (!writer.is_open()) {
+            std::cerr << "ERROR: cannot open " << path << "\n";
+            return 1;
+        }
+        for (const auto& c : cases) writer.submit(c.results);
+    }
+
+    std::vector<std::vector<std::string>> logged;
+    {
+        score_log::Mapped_File log(path);
+        score_log::scan(log.data(), log.size(), [&](const score_log::Game_View& g) {
+            std::vector<std::string> players;
+            for (const auto& e : g.entries) players.emplace_back(e.player);
+            logged.push_back(std::move(players));
+        });
+    }
+    unlink(path.c_str());
+    unlink((path + ".idx").c_str());
+    rmdir(dir);
+
+    int failures = 0;
+    for (size_t i = 0; i < cases.size(); ++i) {
+        bool ok = i < logged.size() && logged[i] == cases[i].expected;
+        std::cout << (ok ? "ok   " : "FAIL ") << cases[i].name << "\n";
+        if (!ok) ++failures;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,146 @@
+#pragma once   // Ensure this header is included at most once in each translation unit.
+
+/* --------------------------------------------------------------------------
+ * Standard-library headers required for the reader thread, the lock-free
+ * ring buffer, and file access.
+ * --------------------------------------------------------------------------*/
+#include <array>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <utility>
+
+#include "common.hpp"   // get_next_line for reading one COEFF line.
+#include "message.hpp"  // verify_COEFF for parsing it off the reactor thread.
+#include "fixed.hpp"    // Coefficients are kept as exact fixed-point values.
+
+/* --------------------------------------------------------------------------
+ * The coeff namespace streams the coefficient file ahead of HELLO bursts so
+ * the reactor never blocks on getline() while clients are waiting.
+ * --------------------------------------------------------------------------*/
+namespace coeff {
+
+    /* ----------------------------------------------------------------------
+     * Record is one pre-read line of the coefficient file: the raw text that
+     * is sent to the client as COEFF and the coefficients parsed from it.
+     * -------------------------------------------------------------------- */
+    struct Record {
+        std::string               line;           // Line with '\n' appended, empty on EOF.
+        std::vector<fixed::Value> values;         // Parsed coefficients, meaningful only when valid.
+        bool                      valid = false;  // True when verify_COEFF accepted the line.
+    };
+
+    /* ----------------------------------------------------------------------
+     * SpscQueue is a bounded single-producer/single-consumer ring buffer.
+     * head is written only by the consumer and tail only by the producer, so
+     * a pair of acquire/release atomics is all the synchronisation needed.
+     * Capacity must be a power of two.
+     * -------------------------------------------------------------------- */
+    template <typename T, size_t Capacity>
+    class SpscQueue {
+        static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+    private:
+        std::array<T, Capacity> slots;
+        alignas(64) std::atomic<size_t> head{0};   // Next slot to pop.
+        alignas(64) std::atomic<size_t> tail{0};   // Next slot to push.
+    public:
+        // try_push moves value into the queue; returns false when it is full.
+        bool try_push(T&& value) {
+            size_t t = tail.load(std::memory_order_relaxed);
+            if (t - head.load(std::memory_order_acquire) == Capacity) return false;
+            slots[t & (Capacity - 1)] = std::move(value);
+            tail.store(t + 1, std::memory_order_release);
+            return true;
+        }
+
+        // try_pop moves the oldest element into out; returns false when empty.
+        bool try_pop(T& out) {
+            size_t h = head.load(std::memory_order_relaxed);
+            if (h == tail.load(std::memory_order_acquire)) return false;
+            out = std::move(slots[h & (Capacity - 1)]);
+            head.store(h + 1, std::memory_order_release);
+            return true;
+        }
+    };
+
+    /* ----------------------------------------------------------------------
+     * Prefetcher owns the coefficient file and a background thread that reads
+     * and parses lines into a SpscQueue.  The reactor thread only pops; when
+     * the queue runs dry before EOF it counts and reports a stall, then waits
+     * for the reader so the client still receives the right line.
+     * -------------------------------------------------------------------- */
+    class Prefetcher {
+    private:
+        static constexpr size_t QUEUE_CAPACITY = 1024;
+
+        std::ifstream file;
+        SpscQueue<Record, QUEUE_CAPACITY> queue;
+        std::atomic<bool> stop{false};      // Set by the destructor.
+        std::atomic<bool> eof{false};       // Set by the reader after the last push.
+        size_t stall_count = 0;             // Touched only by the consumer.
+        std::thread reader;
+
+        // run is the body of the reader thread.
+        void run() {
+            while (!stop.load(std::memory_order_relaxed)) {
+                Record rec;
+                rec.line = common::get_next_line(file);
+                if (rec.line.empty()) break;
+                rec.valid = verification::verify_COEFF(rec.line, rec.values);
+                while (!queue.try_push(std::move(rec))) {
+                    if (stop.load(std::memory_order_relaxed)) return;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            }
+            eof.store(true, std::memory_order_release);
+        }
+
+    public:
+        explicit Prefetcher(const std::string& filename) : file(filename) {
+            if (file.is_open()) {
+                reader = std::thread(&Prefetcher::run, this);
+            }
+        }
+
+        Prefetcher(const Prefetcher&) = delete;
+        Prefetcher& operator=(const Prefetcher&) = delete;
+
+        ~Prefetcher() {
+            stop.store(true, std::memory_order_relaxed);
+            if (reader.joinable()) reader.join();
+        }
+
+        bool is_open() const {
+            return file.is_open();
+        }
+
+        /* next hands out the following record.  It returns false with an empty
+         * record once the file is exhausted, mirroring get_next_line. */
+        bool next(Record& out) {
+            if (queue.try_pop(out)) return true;
+            if (!eof.load(std::memory_order_acquire)) {
+                ++stall_count;
+                std::cerr << "WARNING: coefficient queue ran dry (stall " << stall_count << ")\n";
+            }
+            while (!queue.try_pop(out)) {
+                if (eof.load(std::memory_order_acquire)) {
+                    // The reader may have pushed its last record right before EOF.
+                    if (queue.try_pop(out)) return true;
+                    out = Record{};
+                    return false;
+                }
+                std::this_thread::yield();
+            }
+            return true;
+        }
+
+        size_t stalls() const {
+            return stall_count;
+        }
+    };
+
+} // namespace coeff
@@ -5,6 +5,7 @@
 // facilities needed to parse command-line arguments and format values.
 // -----------------------------------------------------------------------------
 #include <unistd.h>    // getopt for option parsing.
+#include <sched.h>     // CPU_SETSIZE for validating -C.
 #include <cstdlib>     // strtoul for numeric conversion.
 #include <cerrno>      // errno for error detection after strtoul.
 #include <cstdint>     // Fixed-width integer types such as uint16_t.
@@ -21,6 +22,27 @@
 // both the client and the server without name collisions.
 
 namespace common {
+    // ServerTuning gathers optional, performance-related server settings that
+    // are not part of the required command line; defaults keep the plain
+    // blocking poll() reactor.
+    struct ServerTuning {
+        int busy_poll_us = 0;    // -B: spin budget and SO_BUSY_POLL value in µs, 0 = off.
+        int pin_cpu      = -1;   // -C: CPU the reactor thread is pinned to, -1 = any.
+
+        // Socket options applied to every accepted client; 0 keeps the kernel default.
+        bool tcp_nodelay   = true; // -N disables: small PUT/STATE lines skip Nagle.
+        int  sndbuf        = 0;    // -S: SO_SNDBUF in bytes.
+        int  rcvbuf        = 0;    // -R: SO_RCVBUF in bytes.
+        int  notsent_lowat = 0;    // -L: TCP_NOTSENT_LOWAT in bytes.
+
+        // Admission control at accept time; 0 disables each limit.
+        double accept_rate   = 0;  // -r: new connections per second per source address.
+        double accept_burst  = 0;  // -b: bucket size, defaults to max(1, rate).
+        int    max_pending   = 0;  // -H: connections allowed to be waiting for HELLO.
+
+        std::string score_log;     // -l: append finished games to this log, empty = off.
+    };
+
     // read_port converts a C-string to a 16-bit port number and aborts on error.
     inline uint16_t read_port(const char *str) {
         char *endptr;
@@ -41,15 +63,18 @@ namespace common {
                                    int&         k,        // Defaults to 100.
                                    int&         n,        // Defaults to 4.
                                    int&         m,        // Defaults to 131.
-                                   std::string& filename) // Mandatory option.
+                                   std::string& filename, // Mandatory option.
+                                   ServerTuning& tuning)  // Optional tuning flags.
     {
         // Track whether each option has already been seen to catch duplicates.
         bool got_p = false, got_k = false, got_n = false,
-            got_m = false, got_f = false;
+            got_m = false, got_f = false, got_B = false, got_C = false,
+            got_S = false, got_R = false, got_L = false,
+            got_r = false, got_b = false, got_H = false, got_l = false;
 
         opterr = 0;                                          // Silence getopt’s own messages.
         int ch;
-        while ((ch = getopt(argc, argv, "p:k:n:m:f:")) != -1) {
+        while ((ch = getopt(argc, argv, "p:k:n:m:f:B:C:NS:R:L:r:b:H:l:")) != -1) {
             switch (ch) {
             case 'p':   // Port on which to listen.
                 if (got_p) fatal("ERROR: option -p given more than once");
@@ -87,6 +112,74 @@ namespace common {
                 got_f = true;
                 break;
 
+            case 'B':   // Busy-poll spin budget in microseconds.
+                if (got_B) fatal("ERROR: option -B given more than once");
+                tuning.busy_poll_us = std::stoi(optarg);
+                if (tuning.busy_poll_us < 0 || tuning.busy_poll_us > 1000000)
+                    fatal("ERROR: -B must be in range 0…1000000");
+                got_B = true;
+                break;
+
+            case 'C':   // CPU to pin the reactor thread to.
+                if (got_C) fatal("ERROR: option -C given more than once");
+                tuning.pin_cpu = std::stoi(optarg);
+                if (tuning.pin_cpu < 0 || tuning.pin_cpu >= CPU_SETSIZE)
+                    fatal("ERROR: -C must be a valid CPU number");
+                got_C = true;
+                break;
+
+            case 'N':   // Keep Nagle's algorithm on client sockets.
+                tuning.tcp_nodelay = false;
+                break;
+
+            case 'S':   // Kernel send buffer size for client sockets.
+                if (got_S) fatal("ERROR: option -S given more than once");
+                tuning.sndbuf = std::stoi(optarg);
+                if (tuning.sndbuf < 0) fatal("ERROR: -S must not be negative");
+                got_S = true;
+                break;
+
+            case 'R':   // Kernel receive buffer size for client sockets.
+                if (got_R) fatal("ERROR: option -R given more than once");
+                tuning.rcvbuf = std::stoi(optarg);
+                if (tuning.rcvbuf < 0) fatal("ERROR: -R must not be negative");
+                got_R = true;
+                break;
+
+            case 'L':   // Unsent-bytes threshold for POLLOUT on client sockets.
+                if (got_L) fatal("ERROR: option -L given more than once");
+                tuning.notsent_lowat = std::stoi(optarg);
+                if (tuning.notsent_lowat < 0) fatal("ERROR: -L must not be negative");
+                got_L = true;
+                break;
+
+            case 'r':   // Per-address connection rate.
+                if (got_r) fatal("ERROR: option -r given more than once");
+                tuning.accept_rate = std::stod(optarg);
+                if (!(tuning.accept_rate >= 0)) fatal("ERROR: -r must not be negative");
+                got_r = true;
+                break;
+
+            case 'b':   // Per-address burst allowance.
+                if (got_b) fatal("ERROR: option -b given more than once");
+                tuning.accept_burst = std::stod(optarg);
+                if (!(tuning.accept_burst >= 1)) fatal("ERROR: -b must be at least 1");
+                got_b = true;
+                break;
+
+            case 'H':   // Cap on connections that have not sent HELLO yet.
+                if (got_H) fatal("ERROR: option -H given more than once");
+                tuning.max_pending = std::stoi(optarg);
+                if (tuning.max_pending < 0) fatal("ERROR: -H must not be negative");
+                got_H = true;
+                break;
+
+            case 'l':   // Persistent score log.
+                if (got_l) fatal("ERROR: option -l given more than once");
+                tuning.score_log = optarg;
+                got_l = true;
+                break;
+
             default:
                 fatal("ERROR: unknown flag");
             }
@@ -0,0 +1,213 @@
+#pragma once   // Ensure this header is included at most once in each translation unit.
+
+/* --------------------------------------------------------------------------
+ * Standard-library headers required for integer formatting and parsing.
+ * --------------------------------------------------------------------------*/
+#include <cstdint>
+#include <cctype>
+#include <cfloat>
+#include <cmath>
+#include <compare>
+#include <charconv>
+#include <limits>
+#include <string>
+#include <string_view>
+
+#include "common.hpp"   // to_rational for scores that left the exact range.
+
+/* --------------------------------------------------------------------------
+ * The fixed namespace implements the protocol's numbers exactly: every
+ * rational on the wire has at most seven decimals, so it is stored as an
+ * int64 count of 1e-7 units.  Parsing and formatting are integer-only, and
+ * server and client see bit-identical values.
+ * --------------------------------------------------------------------------*/
+namespace fixed {
+
+    constexpr int     DIGITS = 7;             // Decimals allowed by the protocol.
+    constexpr int64_t SCALE  = 10'000'000;    // Units per whole point.
+    constexpr size_t  MAX_CHARS = 28;         // Longest formatted value, sign included.
+
+    // wide holds intermediate products such as squared errors.
+    __extension__ typedef __int128 wide;
+
+    /* Value is one protocol rational expressed in 1e-7 units. */
+    struct Value {
+        int64_t units = 0;
+
+        // points builds a Value from a whole number of points.
+        static constexpr Value points(int64_t p) {
+            return Value{ p * SCALE };
+        }
+
+        Value& operator+=(Value other) {
+            units += other.units;
+            return *this;
+        }
+
+        friend Value operator+(Value a, Value b) { return Value{ a.units + b.units }; }
+        friend Value operator-(Value a, Value b) { return Value{ a.units - b.units }; }
+
+        auto operator<=>(const Value&) const = default;
+    };
+
+    /* well_formed checks the rational grammar: optional minus, digits,
+     * optional period, up to seven decimals. */
+    inline bool well_formed(std::string_view token) {
+        size_t i = 0;
+        if (i < token.size() && token[i] == '-') ++i;
+        size_t int_start = i;
+        while (i < token.size() && std::isdigit(static_cast<unsigned char>(token[i]))) ++i;
+        if (i == int_start) return false;
+        if (i == token.size()) return true;
+        if (token[i] != '.') return false;
+        size_t frac_start = ++i;
+        while (i < token.size() && std::isdigit(static_cast<unsigned char>(token[i]))) ++i;
+        return i == token.size() && i - frac_start <= DIGITS;
+    }
+
+    /* parse converts a well-formed token to a Value without floating point.
+     * It fails only on malformed input.  A magnitude that does not fit in
+     * int64 saturates to the largest Value of its sign, so it still fails
+     * every range check a larger number would, e.g. the PUT bounds that
+     * answer BAD_PUT. */
+    inline bool parse(std::string_view token, Value& out) {
+        if (!well_formed(token)) return false;
+        bool negative = token[0] == '-';
+        size_t i = negative ? 1 : 0;
+
+        constexpr uint64_t LIMIT = static_cast<uint64_t>(std::numeric_limits<int64_t>::max());
+        auto saturate = [&] {
+            out.units = negative ? std::numeric_limits<int64_t>::min()
+                                 : std::numeric_limits<int64_t>::max();
+            return true;
+        };
+        uint64_t units = 0;
+        for (; i < token.size() && token[i] != '.'; ++i) {
+            units = units * 10 + static_cast<uint64_t>(token[i] - '0');
+            if (units > LIMIT / SCALE) return saturate();
+        }
+        units *= SCALE;
+
+        uint64_t frac = 0;
+        int frac_digits = 0;
+        if (i < token.size()) {
+            for (++i; i < token.size(); ++i, ++frac_digits) {
+                frac = frac * 10 + static_cast<uint64_t>(token[i] - '0');
+            }
+        }
+        for (; frac_digits < DIGITS; ++frac_digits) frac *= 10;
+        units += frac;
+        if (units > LIMIT) return saturate();
+
+        out.units = negative ? -static_cast<int64_t>(units) : static_cast<int64_t>(units);
+        return true;
+    }
+
+    /* format writes v into out (at least MAX_CHARS bytes) with trailing zeros
+     * and a dangling period trimmed, and returns the number of characters. */
+    inline size_t format(Value v, char* out) {
+        char* p = out;
+        uint64_t magnitude = v.units < 0 ? 0 - static_cast<uint64_t>(v.units)
+                                         : static_cast<uint64_t>(v.units);
+        if (v.units < 0) *p++ = '-';
+        p = std::to_chars(p, out + MAX_CHARS, magnitude / SCALE).ptr;
+
+        uint64_t frac = magnitude % SCALE;
+        if (frac != 0) {
+            int digits = DIGITS;
+            while (frac % 10 == 0) {
+                frac /= 10;
+                --digits;
+            }
+            *p++ = '.';
+            for (int d = digits - 1; d >= 0; --d) {
+                p[d] = static_cast<char>('0' + frac % 10);
+                frac /= 10;
+            }
+            p += digits;
+        }
+        return static_cast<size_t>(p - out);
+    }
+
+    /* formatted_size returns format()'s length without writing anything. */
+    inline size_t formatted_size(Value v) {
+        uint64_t magnitude = v.units < 0 ? 0 - static_cast<uint64_t>(v.units)
+                                         : static_cast<uint64_t>(v.units);
+        size_t size = v.units < 0 ? 1 : 0;
+        uint64_t whole = magnitude / SCALE;
+        do {
+            ++size;
+            whole /= 10;
+        } while (whole != 0);
+
+        uint64_t frac = magnitude % SCALE;
+        if (frac != 0) {
+            size_t digits = DIGITS;
+            while (frac % 10 == 0) {
+                frac /= 10;
+                --digits;
+            }
+            size += 1 + digits;
+        }
+        return size;
+    }
+
+    inline std::string to_string(Value v) {
+        char buf[MAX_CHARS];
+        return std::string(buf, format(v, buf));
+    }
+
+    // to_double is exact up to 2^53 units and correctly rounded beyond.
+    inline double to_double(Value v) {
+        return static_cast<double>(v.units) / static_cast<double>(SCALE);
+    }
+
+    // from_double rounds to the nearest representable Value.
+    inline Value from_double(double d) {
+        return Value{ static_cast<int64_t>(std::llround(d * static_cast<double>(SCALE))) };
+    }
+
+    /* ----------------------------------------------------------------------
+     * Score is a game result.  It is exact (in 1e-7 units) whenever the sum of
+     * squared errors fits in 128 bits; larger games fall back to long double.
+     * -------------------------------------------------------------------- */
+    struct Score {
+        bool        exact  = true;
+        wide        units  = 0;     // Valid when exact.
+        long double approx = 0;     // Valid when !exact.
+    };
+
+    // Scores order by value, lower is better; exact ones compare exactly.
+    inline bool operator<(const Score& a, const Score& b) {
+        if (a.exact && b.exact) return a.units < b.units;
+        auto value = [](const Score& s) {
+            return s.exact ? static_cast<long double>(s.units) / SCALE : s.approx;
+        };
+        return value(a) < value(b);
+    }
+
+    inline std::string to_string(const Score& score) {
+        if (!score.exact) {
+            return common::to_rational(static_cast<double>(score.approx));
+        }
+        // Non-negative by construction: squared errors plus penalties.
+        char buf[64];
+        char* end = buf + sizeof(buf);
+        char* p = end;
+        wide whole = score.units / SCALE;
+        do {
+            *--p = static_cast<char>('0' + static_cast<int>(whole % 10));
+            whole /= 10;
+        } while (whole != 0);
+        std::string res(p, end);
+
+        Value frac{ static_cast<int64_t>(score.units % SCALE) };
+        if (frac.units != 0) {
+            char frac_buf[MAX_CHARS];
+            size_t n = format(frac, frac_buf);
+            res.append(frac_buf + 1, n - 1);   // Skip the leading "0".
+        }
+        return res;
+    }
+
+} // namespace fixed
@@ -0,0 +1,124 @@
+// Fuzz harness for every parser in namespace verification.
+//
+// Built with clang and -fsanitize=fuzzer (make fuzz-libfuzzer) it is a regular
+// libFuzzer target; pass fuzz-corpus/ as the seed corpus.  Built with plain g++
+// (make fuzz) it replays files and directories given on the command line,
+// which is how the deterministic corpus is run under the sanitizers.
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <utility>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <filesystem>
+
+#include "message.hpp"
+#include "fixed.hpp"
+#include "err.h"
+
+// check_round_trip rebuilds an accepted line and requires it to parse to the
+// same values again, which catches formatter/parser disagreements.
+static void check_round_trip(const std::vector<fixed::Value>& values,
+                             bool (*verify)(const std::string&, std::vector<fixed::Value>&),
+                             const std::string& rebuilt) {
+    std::vector<fixed::Value> again;
+    if (!verify(rebuilt, again) || again != values) {
+        std::cerr << "round trip mismatch: " << rebuilt;
+        std::abort();
+    }
+}
+
+// PUT_Real reads a PUT's value as a double, the way the protocol accepted it
+// before values became fixed-point.
+using PUT_Real = schema::Message<"PUT", schema::Field<schema::Kind::Int>,
+                                 schema::Field<schema::Kind::Real>>;
+
+// check_put_range requires a PUT readable as a double to parse as a Value
+// too, and to land on the same side of the +-5 bounds, so a value too large
+// for fixed point is still answered with BAD_PUT rather than dropped.
+static void check_put_range(const std::string& msg) {
+    int point = 0;
+    double real = 0.0;
+    if (!PUT_Real::parse(msg, point, real)) return;
+    fixed::Value value;
+    bool in_range = real <= 5.0 && real >= -5.0;
+    if (!verification::verify_PUT(msg, point, value)
+        || in_range != (value <= fixed::Value::points(5) && value >= fixed::Value::points(-5))) {
+        std::cerr << "PUT range mismatch: " << msg;
+        std::abort();
+    }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    const std::string msg(reinterpret_cast<const char*>(data), size);
+
+    std::string id;
+    verification::verify_HELLO(msg, id);
+
+    std::vector<fixed::Value> coeffs;
+    if (verification::verify_COEFF(msg, coeffs)) {
+        std::vector<std::string> text;
+        for (fixed::Value v : coeffs) text.push_back(fixed::to_string(v));
+        check_round_trip(coeffs, verification::verify_COEFF, message::COEFF_msg(text));
+    }
+
+    int point = 0;
+    fixed::Value value;
+    if (verification::verify_PUT(msg, point, value)) {
+        int point2 = 0;
+        fixed::Value value2;
+        if (!verification::verify_PUT(message::PUT_msg(std::to_string(point), fixed::to_string(value)), point2, value2)
+            || point2 != point || value2 != value) {
+            std::cerr << "round trip mismatch: " << msg;
+            std::abort();
+        }
+    }
+    check_put_range(msg);
+
+    double real = 0.0;
+    verification::verify_PENALTY(msg, point, real);
+    verification::verify_BAD_PUT(msg, point, real);
+
+    std::vector<fixed::Value> states;
+    if (verification::verify_STATE(msg, states)) {
+        check_round_trip(states, verification::verify_STATE, message::STATE_msg(states));
+    }
+
+    std::vector<std::pair<std::string, double>> scores;
+    verification::verify_SCORING(msg, scores);
+    return 0;
+}
+
+#ifndef LIBFUZZER
+// replay feeds one file to the harness.
+static void replay(const std::filesystem::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) fatal("cannot open " + path.string());
+    std::ostringstream content;
+    content << in.rdbuf();
+    const std::string bytes = content.str();
+    LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size());
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) fatal("usage: fuzz-verification <file-or-directory>...");
+    size_t count = 0;
+    for (int i = 1; i < argc; ++i) {
+        std::filesystem::path path(argv[i]);
+        if (std::filesystem::is_directory(path)) {
+            for (const auto& entry : std::filesystem::directory_iterator(path)) {
+                if (!entry.is_regular_file()) continue;
+                replay(entry.path());
+                ++count;
+            }
+        } else {
+            replay(path);
+            ++count;
+        }
+    }
+    std::cout << "replayed " << count << " inputs\n";
+    return 0;
+}
+#endif
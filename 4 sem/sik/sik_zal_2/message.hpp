@@ -2,307 +2,469 @@
 
 /* --------------------------------------------------------------------------
  * Standard-library headers required for string handling, tokenisation, and
- * numeric limits used when validating incoming messages.
+ * numeric conversion used when building and validating messages.
  * --------------------------------------------------------------------------*/
 #include <string>
+#include <string_view>
 #include <vector>
-#include <sstream>
+#include <tuple>
+#include <utility>
 #include <limits>
+#include <charconv>
+#include <cctype>
+#include <cstdint>
+#include <type_traits>
+#include <algorithm>
+
+#include "fixed.hpp"   // Exact 1e-7 fixed-point values used for rationals.
 
 /* --------------------------------------------------------------------------
- * The message namespace contains helper functions that *build* protocol lines
- * for transmission over the TCP connection.
+ * The schema namespace describes every protocol message at compile time: a
+ * command name followed by an ordered list of fields.  From one declaration
+ * it generates a builder that sizes the line before writing it and a parser
+ * that walks the line in place, without substr() copies or token vectors.
  * --------------------------------------------------------------------------*/
+namespace schema {
 
-namespace message {
+    /* Name is a string literal usable as a template argument. */
+    template <size_t N>
+    struct Name {
+        char text[N];
 
-    /* add_suffix appends “\r\n” so every generated string is a complete,
-     * CR-LF-terminated line ready for send(). */
-    inline void add_suffix(std::string& msg) {
-        msg.push_back('\r');  // Carriage Return (ASCII 13)
-        msg.push_back('\n');  // Line Feed (ASCII 10)
+        constexpr Name(const char (&s)[N]) {
+            for (size_t i = 0; i < N; ++i) text[i] = s[i];
+        }
+
+        constexpr std::string_view view() const {
+            return std::string_view(text, N - 1);
+        }
+    };
+
+    /* Kind lists the token grammars that appear in the protocol. */
+    enum class Kind {
+        Int,        // Non-negative decimal integer that fits in int.
+        Rational,   // Optional minus, digits, optional period and up to 7 decimals.
+        Real,       // Same grammar as Rational, for unbounded values such as scores.
+        AlnumId     // Non-empty run of ASCII letters and digits.
+    };
+
+    /* Field<K> is exactly one token of kind K. */
+    template <Kind K>
+    struct Field {};
+
+    /* Repeated<Min, Max, Ks...> is a group of tokens (one per kind in Ks)
+     * that repeats between Min and Max times.  It must be the last field. */
+    inline constexpr size_t UNBOUNDED = std::numeric_limits<size_t>::max();
+
+    template <size_t Min, size_t Max, Kind... Ks>
+    struct Repeated {};
+
+    /* Body<K> is the entire remaining body taken verbatim as one token of
+     * kind K, so surrounding whitespace is rejected instead of skipped. */
+    template <Kind K>
+    struct Body {};
+
+    /* ----------------------------------------------------------------------
+     * Token-level parsing.
+     * -------------------------------------------------------------------- */
+
+    /* value_t maps a Kind to the C++ type a parsed token is stored in. */
+    template <Kind K> struct value;
+    template <> struct value<Kind::Int>      { using type = int; };
+    template <> struct value<Kind::Rational> { using type = fixed::Value; };
+    template <> struct value<Kind::Real>     { using type = double; };
+    template <> struct value<Kind::AlnumId>  { using type = std::string; };
+
+    template <Kind K>
+    using value_t = typename value<K>::type;
+
+    inline bool is_digit(char ch) {
+        return std::isdigit(static_cast<unsigned char>(ch)) != 0;
     }
 
-    /* HELLO_msg formats the initial greeting sent by a client. */
-    inline std::string HELLO_msg(const std::string& player_id) {
-        std::string res = "HELLO " + player_id;
-        add_suffix(res);
-        return res;
+    inline bool is_space(char ch) {
+        return std::isspace(static_cast<unsigned char>(ch)) != 0;
     }
 
-    /* COEFF_msg sends the polynomial coefficients from server to client. */
-    inline std::string COEFF_msg(const std::vector<std::string>& coeff) {
-        std::string res = "COEFF";
-        for (const auto& c : coeff) {
-            res += ' ';
-            res += c;
+    /* parse_int accepts digits only and rejects values that overflow int. */
+    inline bool parse_int(std::string_view token, int& out) {
+        if (token.empty()) return false;
+        for (char ch : token) {
+            if (!is_digit(ch)) return false;
         }
-        add_suffix(res);
-        return res;
+        auto [ptr, ec] = std::from_chars(token.data(), token.data() + token.size(), out);
+        return ec == std::errc() && ptr == token.data() + token.size();
     }
 
-    /* PUT_msg carries a player’s suggested adjustment to the prediction vector. */
-    inline std::string PUT_msg(const std::string& point, const std::string& value) {
-        std::string res = "PUT " + point + " " + value;
-        add_suffix(res);
-        return res;
+    /* parse_real checks the rational grammar and converts with from_chars,
+     * for values that may exceed the fixed-point range. */
+    inline bool parse_real(std::string_view token, double& out) {
+        if (!fixed::well_formed(token)) return false;
+        auto [ptr, ec] = std::from_chars(token.data(), token.data() + token.size(), out);
+        (void) ptr;
+        return ec == std::errc();
     }
 
-    /* BAD_PUT_msg tells the client that its previous PUT was malformed. */
-    inline std::string BAD_PUT_msg(const std::string& point, const std::string& value) {
-        std::string res = "BAD_PUT " + point + " " + value;
-        add_suffix(res);
-        return res;
+    /* parse_alnum_id accepts a non-empty run of letters and digits. */
+    inline bool parse_alnum_id(std::string_view token, std::string& out) {
+        if (token.empty()) return false;
+        for (char ch : token) {
+            if (!std::isalnum(static_cast<unsigned char>(ch))) return false;
+        }
+        out.assign(token);
+        return true;
     }
 
-    /* STATE_msg publishes the entire prediction vector after a legal PUT. */
-    inline std::string STATE_msg(const std::vector<std::string>& values) {
-        std::string res = "STATE";
-        for (const auto& v : values) {
-            res += ' ';
-            res += v;
-        }
-        add_suffix(res);
-        return res;
+    template <Kind K>
+    bool parse_token(std::string_view token, value_t<K>& out) {
+        if constexpr (K == Kind::Int)           return parse_int(token, out);
+        else if constexpr (K == Kind::Rational) return fixed::parse(token, out);
+        else if constexpr (K == Kind::Real)     return parse_real(token, out);
+        else                                    return parse_alnum_id(token, out);
     }
 
-    /* PENALTY_msg imposes a fixed penalty because the client broke a rule. */
-    inline std::string PENALTY_msg(const std::string& point, const std::string& value) {
-        std::string res = "PENALTY " + point + " " + value;
-        add_suffix(res);
-        return res;
+    /* token_size and append_token let builders take tokens either as text or
+     * as numbers, which are then formatted straight into the line. */
+    inline size_t token_size(std::string_view token) {
+        return token.size();
     }
 
-    /* SCORING_msg ends the game and reports every player’s final score. */
-    inline std::string SCORING_msg(const std::vector<std::string>& id, const std::vector<std::string>& score) {
-        std::string res = "SCORING";
-        size_t n = std::min(id.size(), score.size());
-        for (size_t i = 0; i < n; ++i) {
-            res += ' ';
-            res += id[i];
-            res += ' ';
-            res += score[i];
-        }
-        add_suffix(res);
-        return res;
+    inline void append_token(std::string& out, std::string_view token) {
+        out.append(token);
     }
 
-} // namespace message
+    inline size_t token_size(int value) {
+        char buf[16];
+        return static_cast<size_t>(std::to_chars(buf, buf + sizeof(buf), value).ptr - buf);
+    }
 
-namespace verification {
+    inline void append_token(std::string& out, int value) {
+        char buf[16];
+        out.append(buf, std::to_chars(buf, buf + sizeof(buf), value).ptr);
+    }
 
-    /* extract_body verifies that msg starts with prefix and ends with suffix,
-     * then returns the substring in between. */
-    static bool extract_body(const std::string& msg,
-                             const std::string& prefix,
-                             const std::string& suffix,
-                             std::string& out_body) {
-        if (msg.size() <= prefix.size() + suffix.size()) return false;
-        if (msg.compare(0, prefix.size(), prefix) != 0) return false;
-        if (msg.compare(msg.size() - suffix.size(), suffix.size(), suffix) != 0) return false;
-        out_body = msg.substr(prefix.size(),
-                              msg.size() - prefix.size() - suffix.size());
-        return !out_body.empty();
+    inline size_t token_size(fixed::Value value) {
+        return fixed::formatted_size(value);
     }
 
-    /* is_alnum_str returns true only when every character is a letter or digit. */
-    static bool is_alnum_str(const std::string& s) {
-        if (s.empty()) return false;
+    inline void append_token(std::string& out, fixed::Value value) {
+        char buf[fixed::MAX_CHARS];
+        out.append(buf, fixed::format(value, buf));
+    }
 
-        for (char ch : s)
-            if (!std::isalnum(static_cast<unsigned char>(ch)))
-                return false;
+    /* Tokenizer hands out whitespace-separated tokens of a line body as views
+     * into the original message. */
+    class Tokenizer {
+    private:
+        std::string_view rest;
+    public:
+        explicit Tokenizer(std::string_view body) : rest(body) {}
+
+        // next returns the following token or an empty view when none is left.
+        std::string_view next() {
+            size_t i = 0;
+            while (i < rest.size() && is_space(rest[i])) ++i;
+            size_t start = i;
+            while (i < rest.size() && !is_space(rest[i])) ++i;
+            std::string_view token = rest.substr(start, i - start);
+            rest.remove_prefix(i);
+            return token;
+        }
 
-        return true;
-    }
+        // remainder returns everything not consumed yet, without trimming.
+        std::string_view remainder() {
+            std::string_view all = rest;
+            rest = std::string_view();
+            return all;
+        }
+    };
+
+    /* ----------------------------------------------------------------------
+     * Field-level traits: what a field parses into, what its builder takes,
+     * and how many bytes it contributes to a line.
+     * -------------------------------------------------------------------- */
+    template <typename F>
+    struct field_traits;
+
+    template <Kind K>
+    struct field_traits<Field<K>> {
+        using parsed = value_t<K>;
+
+        template <typename Token>
+        static size_t size(const Token& token) {
+            return 1 + token_size(token);
+        }
+
+        template <typename Token>
+        static void append(std::string& out, const Token& token) {
+            out.push_back(' ');
+            append_token(out, token);
+        }
+
+        static bool parse(Tokenizer& tokens, parsed& out) {
+            return parse_token<K>(tokens.next(), out);
+        }
+    };
+
+    template <Kind K>
+    struct field_traits<Body<K>> : field_traits<Field<K>> {
+        using typename field_traits<Field<K>>::parsed;
+
+        static bool parse(Tokenizer& tokens, parsed& out) {
+            return parse_token<K>(tokens.remainder(), out);
+        }
+    };
+
+    template <Kind... Ks>
+    struct group {
+        static_assert(sizeof...(Ks) == 1 || sizeof...(Ks) == 2,
+                      "repeated groups hold one or two tokens");
+    };
 
-    /* parse_rational converts a token to double while enforcing the project’s
-     * grammar: optional minus, digits, optional period, up to seven decimals. */
-    static bool parse_rational(const std::string& token, double& out_val) {
-        size_t pos = token.find('.');
-        std::string ip = token.substr(0, pos);
-        std::string fp = (pos == std::string::npos ? "" : token.substr(pos + 1));
+    template <Kind K>
+    struct group<K> {
+        using type = value_t<K>;
 
-        if (ip.empty()) return false;
+        static bool parse(std::string_view first, Tokenizer&, type& out) {
+            return parse_token<K>(first, out);
+        }
+    };
+
+    template <Kind K1, Kind K2>
+    struct group<K1, K2> {
+        using type = std::pair<value_t<K1>, value_t<K2>>;
 
-        // Check integer part (allow optional leading minus).
-        size_t start = 0;
-        if (ip[0] == '-') {
-            if (ip.size() == 1) return false;
-            start = 1;
+        static bool parse(std::string_view first, Tokenizer& tokens, type& out) {
+            return parse_token<K1>(first, out.first) && parse_token<K2>(tokens.next(), out.second);
+        }
+    };
+
+    template <size_t Min, size_t Max, Kind... Ks>
+    struct field_traits<Repeated<Min, Max, Ks...>> {
+        using group_type = typename group<Ks...>::type;
+        using parsed     = std::vector<group_type>;
+
+        // Builders take a tuple with one column (container of tokens) per kind;
+        // columns are zipped up to the shortest one.
+        template <typename... Columns>
+        static size_t rows(const std::tuple<Columns...>& columns) {
+            static_assert(sizeof...(Columns) == sizeof...(Ks), "one column per kind");
+            return std::apply([](const auto&... column) {
+                return std::min({ column.size()... });
+            }, columns);
         }
 
-        for (size_t i = start; i < ip.size(); ++i) {
-            if (!std::isdigit(static_cast<unsigned char>(ip[i]))) return false;
+        template <typename... Columns>
+        static size_t size(const std::tuple<Columns...>& columns) {
+            size_t n = rows(columns);
+            size_t total = 0;
+            std::apply([&](const auto&... column) {
+                for (size_t i = 0; i < n; ++i) {
+                    ((total += 1 + token_size(column[i])), ...);
+                }
+            }, columns);
+            return total;
         }
 
-        // Check fractional part.
-        if (pos != std::string::npos) {
-            if (fp.size() > 7) return false;
-            for (char ch : fp) {
-                if (!std::isdigit(static_cast<unsigned char>(ch)))
-                    return false;
+        template <typename... Columns>
+        static void append(std::string& out, const std::tuple<Columns...>& columns) {
+            size_t n = rows(columns);
+            std::apply([&](const auto&... column) {
+                for (size_t i = 0; i < n; ++i) {
+                    ((out.push_back(' '), append_token(out, column[i])), ...);
+                }
+            }, columns);
+        }
+
+        static bool parse(Tokenizer& tokens, parsed& out) {
+            out.clear();
+            for (std::string_view first = tokens.next(); !first.empty(); first = tokens.next()) {
+                if (out.size() == Max) return false;
+                group_type item{};
+                if (!group<Ks...>::parse(first, tokens, item)) return false;
+                out.push_back(std::move(item));
             }
+            return out.size() >= Min;
+        }
+    };
+
+    /* ----------------------------------------------------------------------
+     * Message ties a command name to its fields and generates the builder and
+     * the parser.  A line is "<command> <field> <field> ...\r\n".
+     * -------------------------------------------------------------------- */
+    template <Name Command, typename... Fields>
+    struct Message {
+        static constexpr std::string_view command = Command.view();
+        static constexpr std::string_view suffix  = "\r\n";
+
+        /* build precomputes the exact line length, reserves once and writes.
+         * Single fields take text, an int or a fixed::Value; repeated groups
+         * take a std::tie of one container per kind. */
+        template <typename... Args>
+        static std::string build(const Args&... args) {
+            static_assert(sizeof...(Args) == sizeof...(Fields), "one argument per field");
+            size_t total = command.size() + suffix.size() + (field_traits<Fields>::size(args) + ... + 0);
+            std::string res;
+            res.reserve(total);
+            res.append(command);
+            (field_traits<Fields>::append(res, args), ...);
+            res.append(suffix);
+            return res;
         }
 
-        try {
-            out_val = std::stod(token);
-        } catch (...) {
-            return false;
+        /* parse validates the whole line and stores each field through the
+         * matching output reference.  Outputs may be partially written when
+         * it returns false. */
+        static bool parse(std::string_view msg, typename field_traits<Fields>::parsed&... outs) {
+            if (msg.size() <= command.size() + 1 + suffix.size()) return false;
+            if (!msg.starts_with(command) || msg[command.size()] != ' ') return false;
+            if (!msg.ends_with(suffix)) return false;
+            std::string_view body = msg.substr(command.size() + 1,
+                                               msg.size() - command.size() - 1 - suffix.size());
+            Tokenizer tokens(body);
+            return (field_traits<Fields>::parse(tokens, outs) && ...) && tokens.next().empty();
         }
-        return true;
+    };
+
+    /* ----------------------------------------------------------------------
+     * The protocol.  Adding a message type is one declaration here.
+     * -------------------------------------------------------------------- */
+    using HELLO   = Message<"HELLO",   Body<Kind::AlnumId>>;
+    using COEFF   = Message<"COEFF",   Repeated<1, 8, Kind::Rational>>;
+    using PUT     = Message<"PUT",     Field<Kind::Int>, Field<Kind::Rational>>;
+    using BAD_PUT = Message<"BAD_PUT", Field<Kind::Int>, Field<Kind::Rational>>;
+    using STATE   = Message<"STATE",   Repeated<1, UNBOUNDED, Kind::Rational>>;
+    using PENALTY = Message<"PENALTY", Field<Kind::Int>, Field<Kind::Rational>>;
+    using SCORING = Message<"SCORING", Repeated<1, UNBOUNDED, Kind::AlnumId, Kind::Real>>;
+
+} // namespace schema
+
+/* --------------------------------------------------------------------------
+ * The message namespace contains helper functions that *build* protocol lines
+ * for transmission over the TCP connection.
+ * --------------------------------------------------------------------------*/
+
+namespace message {
+
+    /* HELLO_msg formats the initial greeting sent by a client. */
+    inline std::string HELLO_msg(const std::string& player_id) {
+        return schema::HELLO::build(player_id);
     }
 
+    /* COEFF_msg sends the polynomial coefficients from server to client. */
+    inline std::string COEFF_msg(const std::vector<std::string>& coeff) {
+        return schema::COEFF::build(std::tie(coeff));
+    }
 
+    /* PUT_msg carries a player’s suggested adjustment to the prediction vector. */
+    inline std::string PUT_msg(const std::string& point, const std::string& value) {
+        return schema::PUT::build(point, value);
+    }
 
-    /* split_ws splits a string on ASCII whitespace exactly like a shell. */
-    static std::vector<std::string> split_ws(const std::string& s) {
-        std::istringstream iss(s);
-        std::vector<std::string> toks;
-        std::string tok;
-        while (iss >> tok) toks.push_back(std::move(tok));
-        return toks;
+    /* BAD_PUT_msg tells the client that its previous PUT was malformed. */
+    inline std::string BAD_PUT_msg(const std::string& point, const std::string& value) {
+        return schema::BAD_PUT::build(point, value);
     }
 
-    /* Each verify_XXX function checks a specific message type and returns the
-     * parsed fields through reference parameters when successful. */
-    bool verify_HELLO(const std::string& msg, std::string& out_player_id) {
-        std::string body;
-        if (!extract_body(msg, "HELLO ", "\r\n", body)) return false;
-        if (!is_alnum_str(body)) return false;
-        out_player_id = body;
-        return true;
+    inline std::string BAD_PUT_msg(int point, fixed::Value value) {
+        return schema::BAD_PUT::build(point, value);
     }
 
-    bool verify_COEFF(const std::string& msg, std::vector<double>& out_coeffs) {
-        std::string body;
-        if (!extract_body(msg, "COEFF ", "\r\n", body)) {
-            return false;
-        }
-        auto toks = split_ws(body);
-        if (toks.empty() || toks.size() > 8) {
-            return false;
-        }
-        out_coeffs.clear();
-        for (auto& t : toks) {
-            double v;
-            if (!parse_rational(t, v)) {
-                std::cout<<t<<"bb\r\n";
-                return false;
-            }
-            out_coeffs.push_back(v);
-        }
-        return true;
+    /* STATE_msg publishes the entire prediction vector after a legal PUT. */
+    inline std::string STATE_msg(const std::vector<std::string>& values) {
+        return schema::STATE::build(std::tie(values));
     }
 
-    bool verify_PUT(const std::string& msg, int& out_point, double& out_value) {
-        std::string body;
-        if (!extract_body(msg, "PUT ", "\r\n", body)) return false;
+    inline std::string STATE_msg(const std::vector<fixed::Value>& values) {
+        return schema::STATE::build(std::tie(values));
+    }
 
-        auto toks = split_ws(body);
-        if (toks.size() != 2) return false;
+    /* PENALTY_msg imposes a fixed penalty because the client broke a rule. */
+    inline std::string PENALTY_msg(const std::string& point, const std::string& value) {
+        return schema::PENALTY::build(point, value);
+    }
 
-        /* --- point --- */
-        for (char ch : toks[0]) {
-            if (!std::isdigit(static_cast<unsigned char>(ch)))
-                return false;
-        }
-        try {
-            out_point = std::stoi(toks[0]);
-        } catch (...) {
-            return false;
-        }
+    inline std::string PENALTY_msg(int point, fixed::Value value) {
+        return schema::PENALTY::build(point, value);
+    }
 
-        /* --- value --- */
-        return parse_rational(toks[1], out_value);
+    /* SCORING_msg ends the game and reports every player’s final score. */
+    inline std::string SCORING_msg(const std::vector<std::string>& id, const std::vector<std::string>& score) {
+        return schema::SCORING::build(std::tie(id, score));
     }
 
-    bool verify_PENALTY(const std::string& msg, int& out_point, double& out_value) {
-        std::string body;
-        if (!extract_body(msg, "PENALTY ", "\r\n", body))
-            return false;
+} // namespace message
 
-        auto toks = split_ws(body);
-        if (toks.size() != 2)
-            return false;
+namespace verification {
 
-        /* --- point --- */
-        for (char ch : toks[0]) {
-            if (!std::isdigit(static_cast<unsigned char>(ch)))
-                return false;
-        }
-        try {
-            out_point = std::stoi(toks[0]);
-        } catch (...) {
-            return false;
-        }
+    /* to_doubles converts parsed fixed-point values for callers that do
+     * floating-point math on them, such as the client's strategy. */
+    inline void to_doubles(const std::vector<fixed::Value>& values, std::vector<double>& out) {
+        out.clear();
+        out.reserve(values.size());
+        for (fixed::Value v : values) out.push_back(fixed::to_double(v));
+    }
 
-        /* --- value --- */
-        return parse_rational(toks[1], out_value);
+    /* Each verify_XXX function checks a specific message type and returns the
+     * parsed fields through reference parameters when successful.  Overloads
+     * taking fixed::Value keep the exact representation; the double ones
+     * serve the client. */
+    inline bool verify_HELLO(const std::string& msg, std::string& out_player_id) {
+        std::string player_id;
+        if (!schema::HELLO::parse(msg, player_id)) return false;
+        out_player_id = std::move(player_id);
+        return true;
     }
 
+    inline bool verify_COEFF(const std::string& msg, std::vector<fixed::Value>& out_coeffs) {
+        return schema::COEFF::parse(msg, out_coeffs);
+    }
 
-    bool verify_BAD_PUT(const std::string& msg, int& out_point, double& out_value) {
-        std::string body;
-        if (!extract_body(msg, "BAD_PUT ", "\r\n", body))
-            return false;
+    inline bool verify_COEFF(const std::string& msg, std::vector<double>& out_coeffs) {
+        std::vector<fixed::Value> coeffs;
+        if (!schema::COEFF::parse(msg, coeffs)) return false;
+        to_doubles(coeffs, out_coeffs);
+        return true;
+    }
 
-        auto toks = split_ws(body);
-        if (toks.size() != 2)
-            return false;
+    inline bool verify_PUT(const std::string& msg, int& out_point, fixed::Value& out_value) {
+        return schema::PUT::parse(msg, out_point, out_value);
+    }
 
-        /* --- point --- */
-        for (char ch : toks[0]) {  // ← był unsigned char c
-            if (!std::isdigit(static_cast<unsigned char>(ch)))
-                return false;
-        }
-        try {
-            out_point = std::stoi(toks[0]);
-        } catch (...) {
-            return false;
-        }
+    inline bool verify_PUT(const std::string& msg, int& out_point, double& out_value) {
+        fixed::Value value;
+        if (!schema::PUT::parse(msg, out_point, value)) return false;
+        out_value = fixed::to_double(value);
+        return true;
+    }
 
-        /* --- value --- */
-        return parse_rational(toks[1], out_value);
+    inline bool verify_PENALTY(const std::string& msg, int& out_point, double& out_value) {
+        fixed::Value value;
+        if (!schema::PENALTY::parse(msg, out_point, value)) return false;
+        out_value = fixed::to_double(value);
+        return true;
     }
 
-    bool verify_STATE(const std::string& msg, std::vector<double>& out_states) {
-        std::string body;
-        if (!extract_body(msg, "STATE ", "\r\n", body)) return false;
-        auto toks = split_ws(body);
-        if (toks.empty()) return false;
-        out_states.clear();
-        for (auto& t : toks) {
-            double v;
-            if (!parse_rational(t, v)) return false;
-            out_states.push_back(v);
-        }
+    inline bool verify_BAD_PUT(const std::string& msg, int& out_point, double& out_value) {
+        fixed::Value value;
+        if (!schema::BAD_PUT::parse(msg, out_point, value)) return false;
+        out_value = fixed::to_double(value);
         return true;
     }
 
-    bool verify_SCORING(const std::string& msg, std::vector<std::pair<std::string,double>>& out_scores) {
-        std::string body;
-        if (!extract_body(msg, "SCORING ", "\r\n", body)) {
-            return false;
-        }
-        auto toks = split_ws(body);
-        if (toks.size() < 2 || (toks.size() % 2) != 0) {
-            return false;
-        }
-        out_scores.clear();
-
-        for (size_t i = 0; i < toks.size(); i += 2) {
-            // player_id
-            if (!is_alnum_str(toks[i])) {
-                return false;
-            }// result
-            double r;
-            if (!parse_rational(toks[i+1], r)) {
-                return false;
-            }
-            out_scores.emplace_back(toks[i], r);
-        }
+    inline bool verify_STATE(const std::string& msg, std::vector<fixed::Value>& out_states) {
+        return schema::STATE::parse(msg, out_states);
+    }
+
+    inline bool verify_STATE(const std::string& msg, std::vector<double>& out_states) {
+        std::vector<fixed::Value> states;
+        if (!schema::STATE::parse(msg, states)) return false;
+        to_doubles(states, out_states);
         return true;
     }
 
-} // namespace verification
\ No newline at end of file
+    inline bool verify_SCORING(const std::string& msg, std::vector<std::pair<std::string,double>>& out_scores) {
+        return schema::SCORING::parse(msg, out_scores);
+    }
+
+} // namespace verification
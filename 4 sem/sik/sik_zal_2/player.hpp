@@ -17,11 +17,24 @@
 
 #include "common.hpp"   // Shared helpers such as to_rational and argument parsing.
 #include "message.hpp"  // Wire-protocol builders and verifiers.
+#include "fixed.hpp"    // Exact fixed-point predictions and scores.
+#include "coeff_prefetcher.hpp"  // Background reader of the coefficient file.
 
 /* --------------------------------------------------------------------------
  * All player-related code lives in the player namespace to avoid collisions.
  * --------------------------------------------------------------------------*/
 namespace player{
+    /* ----------------------------------------------------------------------
+     * time_source is the single place where the game core reads the clock.
+     * The server leaves it pointing at steady_clock; offline harnesses such
+     * as bench-approx redirect it to a fake clock to drive timers by hand.
+     * -------------------------------------------------------------------- */
+    namespace time_source {
+        using time_point = std::chrono::steady_clock::time_point;
+
+        inline time_point (*now)() = [] { return std::chrono::steady_clock::now(); };
+    }
+
     /* ----------------------------------------------------------------------
      * Delayed_Message stores a protocol message together with the absolute
      * time at which it should be transmitted.
@@ -36,12 +49,12 @@ namespace player{
         // Construct a delayed message that should be sent after “delay”.
         Delayed_Message(const std::string& msg, const std::chrono::seconds delay) {
             message   = msg;
-            send_time = std::chrono::steady_clock::now() + delay;
+            send_time = time_source::now() + delay;
         }
 
         // Returns true when the message is ready to leave the timer queue.
         bool ready() {
-            return std::chrono::steady_clock::now() >= send_time;       
+            return time_source::now() >= send_time;       
         }
 
         std::chrono::steady_clock::time_point get_send_time() { return send_time; }
@@ -85,9 +98,9 @@ namespace player{
         std::string ip;
 
         /* --------------------------- Gameplay state. ------------------------------------ */
-        std::vector<double> polynomial;     // Coefficients received in COEFF.
-        std::vector<double> prediction;     // Current prediction vector, size k+1.
-        double penalty = 0.0;               // Accumulated penalty points.
+        std::vector<fixed::Value> polynomial;   // Coefficients received in COEFF.
+        std::vector<fixed::Value> prediction;   // Current prediction vector, size k+1.
+        fixed::Value penalty;                   // Accumulated penalty points.
 
         /* --------------------------- I/O buffers. --------------------------------------- */
         std::list<char> received_buffer;    // Inbound byte stream, line-buffered.
@@ -119,8 +132,8 @@ namespace player{
         , m(M)
         , port(p)
         , ip(ip_address)
-        , prediction(k + 1, 0.0)
-        , expiration_date(std::chrono::steady_clock::now() + std::chrono::seconds(3))
+        , prediction(k + 1)
+        , expiration_date(time_source::now() + std::chrono::seconds(3))
         {}
         
         /* ------------------------------------------------------------------
@@ -164,7 +177,7 @@ namespace player{
         /* ------------------------------------------------------------------
          * Accept the polynomial sent by the server in the COEFF message.
          * ---------------------------------------------------------------- */
-        void set_polynomial(const std::vector<double>& polynomial_p) {
+        void set_polynomial(const std::vector<fixed::Value>& polynomial_p) {
             for (int i = 0; i < static_cast<int>(polynomial_p.size()); ++i) {
                 this->polynomial.push_back(polynomial_p[i]);
             }
@@ -173,30 +186,57 @@ namespace player{
         /* ------------------------------------------------------------------
          * Update one element of the prediction vector after a valid PUT.
          * ---------------------------------------------------------------- */
-        void update_prediction(const int point,const double value) {
+        void update_prediction(const int point, const fixed::Value value) {
             prediction[point] += value;
         }
 
         /* ------------------------------------------------------------------
          * calculate_score implements the official scoring formula: the sum of
          * squared errors between prediction and the true polynomial plus any
-         * accumulated penalties.
+         * accumulated penalties.  Everything is integer arithmetic in 1e-7
+         * units with 128-bit intermediates, rounded to 1e-7 once at the end;
+         * only if that overflows does it fall back to long double.
          * ---------------------------------------------------------------- */
-        double calculate_score() const {
+        fixed::Score calculate_score() const {
+            fixed::Score score;
             if (polynomial.size() == 0) {
-                return DBL_MAX;
+                score.exact = false;
+                score.approx = DBL_MAX;
+                return score;
+            }
+            fixed::wide squares = 0;    // Sum of squared errors in 1e-14 units.
+            bool overflow = false;
+            for (int i = 0; i <= k && !overflow; ++i) {
+                fixed::wide value = 0;
+                fixed::wide power = 1;
+                for (size_t j = 0; j < polynomial.size() && !overflow; ++j) {
+                    fixed::wide term;
+                    if (j > 0) overflow |= __builtin_mul_overflow(power, i, &power);
+                    overflow |= __builtin_mul_overflow(power, polynomial[j].units, &term);
+                    overflow |= __builtin_add_overflow(value, term, &value);
+                }
+                fixed::wide diff = prediction[i].units - value;
+                fixed::wide square;
+                overflow |= __builtin_mul_overflow(diff, diff, &square);
+                overflow |= __builtin_add_overflow(squares, square, &squares);
             }
-            double res = 0.0;
+            if (!overflow) {
+                score.units = (squares + fixed::SCALE / 2) / fixed::SCALE + penalty.units;
+                return score;
+            }
+
+            score.exact = false;
             for (int i = 0; i <= k; ++i) {
-                double temp = 0.0;
-                for (int j = 0; j <= n; ++j) {
-                    temp += (std::pow(i, j) * polynomial[j]);
+                long double value = 0.0L;
+                for (size_t j = 0; j < polynomial.size(); ++j) {
+                    value += std::pow(static_cast<long double>(i), static_cast<long double>(j))
+                           * fixed::to_double(polynomial[j]);
                 }
-                double diff = prediction[i] - temp;
-                res += diff * diff;
+                long double diff = fixed::to_double(prediction[i]) - value;
+                score.approx += diff * diff;
             }
-            res += penalty;
-            return res;
+            score.approx += fixed::to_double(penalty);
+            return score;
         }
 
         /* ------------------------------------------------------------------
@@ -205,8 +245,9 @@ namespace player{
          * ---------------------------------------------------------------- */
         std::vector<std::string> string_predictions() {
             std::vector<std::string> res;
+            res.reserve(prediction.size());
             for (int i = 0; i < static_cast<int>(prediction.size()); ++i) {
-                res.push_back(common::to_rational(prediction[i]));
+                res.push_back(fixed::to_string(prediction[i]));
             }
             return res;
         }
@@ -228,7 +269,7 @@ namespace player{
          * outbound responses.  The boolean send_message is set when new data
          * has been queued for sending so the poll loop can add POLLOUT.
          * ---------------------------------------------------------------- */
-        void process_received_buffer(std::ifstream& file, bool& send_message, int& global_current_m, const bool finish) {
+        void process_received_buffer(coeff::Prefetcher& coeffs, bool& send_message, int& global_current_m, const bool finish) {
             std::string msg = "";
             if (finish) return;
             auto it = received_buffer.begin();
@@ -247,18 +288,27 @@ namespace player{
                         } else {
                             std::cout << this->player_id << " RECEIVED " << msg;
                             received_hello = true;
-                            std::string line = common::get_next_line(file);
-                            std::cout << "NEW LINE: " << line;// << "\r\n";
-                            verification::verify_COEFF(line, polynomial);
-                            coeff_state_end = send_buffer.size() + line.size();
+                            // As before prefetching, the line goes out as read even
+                            // when it is malformed or the file has run out; the
+                            // player then has no polynomial and scores DBL_MAX.
+                            coeff::Record rec;
+                            if (!coeffs.next(rec)) {
+                                std::cerr << "WARNING: coefficient file exhausted, " << player_id << " gets an empty COEFF\n";
+                            } else if (!rec.valid) {
+                                std::cerr << "WARNING: bad coefficient line for " << player_id << ": " << rec.line;
+                                rec.values.clear();
+                            }
+                            std::cout << "NEW LINE: " << rec.line;// << "\r\n";
+                            polynomial = std::move(rec.values);
+                            coeff_state_end = send_buffer.size() + rec.line.size();
                             std::cout << this->player_id << " SENDING: COEFF" << "\r\n";
-                            push_send_buffer(line);
+                            push_send_buffer(rec.line);
                             compute_delay(this->player_id);
                             send_message = true; 
                         }
                     } else if (msg.starts_with("PUT")) {
                         int point;
-                        double value;
+                        fixed::Value value;
                         if (!verification::verify_PUT(msg, point, value)) {
                             std::cerr << "ERROR: bad message from " << ip << ": "<< port << ", " << player_id << ": " << msg << "\n";
                         } else if (!put_possible) {
@@ -266,13 +316,13 @@ namespace player{
                                 return;
                             }
                             std::cout << this->player_id << " " << "RECEIVED " << msg;
-                            penalty += 20.0;
+                            penalty += fixed::Value::points(20);
                             std::cout << "SENDING: PENALTY" << "\r\n";
-                            push_send_buffer(message::PENALTY_msg(std::to_string(point), common::to_rational(value)));
-                            if (point < 0 || point > k || value > 5.0 || value < -5.0) {
+                            push_send_buffer(message::PENALTY_msg(point, value));
+                            if (point < 0 || point > k || value > fixed::Value::points(5) || value < fixed::Value::points(-5)) {
                                 std::cout << this->player_id << " " << "SENDING: BAD_PUT" << "\r\n";
-                                push_bad_put_msg(std::to_string(point), common::to_rational(value));
-                                penalty += 10.0;
+                                push_bad_put_msg(point, value);
+                                penalty += fixed::Value::points(10);
                             } else {
                                 send_message = true;
                                 update_prediction(point, value);
@@ -293,10 +343,10 @@ namespace player{
                                     return;
                             }
                             std::cout << this->player_id << " " << "RECEIVED " << msg;
-                            if (point < 0 || point > k || value > 5.0 || value < -5.0) {
+                            if (point < 0 || point > k || value > fixed::Value::points(5) || value < fixed::Value::points(-5)) {
                                 std::cout << this->player_id << " " << "SENDING: BAD_PUT" << "\r\n";
-                                push_bad_put_msg(std::to_string(point), common::to_rational(value));
-                                penalty += 10.0;
+                                push_bad_put_msg(point, value);
+                                penalty += fixed::Value::points(10);
                             } else {
                                 //correct put msg
                                 put_possible = false;
@@ -360,7 +410,7 @@ namespace player{
         }
 
         /* add_penalty is a helper for ad-hoc penalty accumulation. */
-        void add_penalty(const double val) {
+        void add_penalty(const fixed::Value val) {
             penalty += val;
         }
 
@@ -387,11 +437,11 @@ namespace player{
         }
 
         void push_state_msg() {
-            Delayed_Message msg(message::STATE_msg(string_predictions()), std::chrono::seconds(delay));
+            Delayed_Message msg(message::STATE_msg(prediction), std::chrono::seconds(delay));
             timer_queue.push(msg);
         }
 
-        void push_bad_put_msg(const std::string& point, const std::string& value) {
+        void push_bad_put_msg(const int point, const fixed::Value value) {
             Delayed_Message msg(message::BAD_PUT_msg(point, value), std::chrono::seconds(1));
             timer_queue.push(msg);
         }
@@ -405,10 +455,14 @@ namespace player{
         }
 
         bool expired() {
-            auto current_time = std::chrono::steady_clock::now();
+            auto current_time = time_source::now();
             return current_time > expiration_date;
         }
 
+        std::chrono::steady_clock::time_point get_expiration_date() const {
+            return expiration_date;
+        }
+
         /* ------------------------------------------------------------------
          * Destructor is trivial because all containers clean up automatically.
          * ---------------------------------------------------------------- */
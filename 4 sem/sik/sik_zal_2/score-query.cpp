@@ -0,0 +1,125 @@
+// Offline query tool for the score log written by approx-server -l.
+//
+// Usage: ./score-query <log> [-u player_id] [-g game_id]
+//   (no flag)  one line per game: id, end time, player count, winner
+//   -u id      every game the player took part in with rank and score
+//   -g id      the full ranking of one game, located through <log>.idx
+// The log and index are mmap-ed read-only, so the tool is safe to run while
+// the server keeps appending.
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+#include "score_log.hpp"
+#include "err.h"
+
+// format_time renders milliseconds since the epoch as local time.
+std::string format_time(int64_t ms) {
+    time_t secs = static_cast<time_t>(ms / 1000);
+    struct tm local;
+    char buf[32];
+    localtime_r(&secs, &local);
+    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &local);
+    return buf;
+}
+
+// list_games prints a one-line summary of every game.
+void list_games(const score_log::Mapped_File& log) {
+    score_log::scan(log.data(), log.size(), [](const score_log::Game_View& g) {
+        std::cout << "game " << g.id << "  " << format_time(g.end_ms)
+                  << "  players " << g.entries.size();
+        if (!g.entries.empty()) {
+            std::cout << "  winner " << g.entries[0].player << " " << g.entries[0].score;
+        }
+        std::cout << "\n";
+    });
+}
+
+// player_history prints every result of one player, newest last.
+void player_history(const score_log::Mapped_File& log, const std::string& player_id) {
+    size_t games = 0, wins = 0;
+    score_log::scan(log.data(), log.size(), [&](const score_log::Game_View& g) {
+        for (size_t rank = 0; rank < g.entries.size(); ++rank) {
+            if (g.entries[rank].player != player_id) continue;
+            std::cout << "game " << g.id << "  " << format_time(g.end_ms)
+                      << "  rank " << rank + 1 << "/" << g.entries.size()
+                      << "  score " << g.entries[rank].score << "\n";
+            ++games;
+            if (rank == 0) ++wins;
+        }
+    });
+    std::cout << player_id << ": " << games << " games, " << wins << " wins\n";
+}
+
+// show_game looks the game up in the index (ids are increasing, so a binary
+// search suffices) and decodes only that record.
+bool show_game(const score_log::Mapped_File& log, const std::string& index_path, uint64_t id) {
+    score_log::Mapped_File index(index_path);
+    size_t count = index.size() / sizeof(score_log::Index_Entry);
+    auto entry_at = [&](size_t i) {
+        score_log::Index_Entry e;
+        std::memcpy(&e, index.data() + i * sizeof(e), sizeof(e));
+        return e;
+    };
+
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (entry_at(mid).game_id < id) lo = mid + 1; else hi = mid;
+    }
+    if (lo == count || entry_at(lo).game_id != id) return false;
+
+    score_log::Index_Entry e = entry_at(lo);
+    score_log::Game_View g;
+    if (e.offset >= log.size() || score_log::decode_at(log.data(), log.size(), e.offset, g) == 0 || g.id != id) {
+        fatal("index entry for game " + std::to_string(id) + " does not match the log");
+    }
+    std::cout << "game " << g.id << "  " << format_time(g.end_ms) << "\n";
+    for (size_t rank = 0; rank < g.entries.size(); ++rank) {
+        std::cout << "  " << rank + 1 << ". " << g.entries[rank].player
+                  << " " << g.entries[rank].score << "\n";
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2 || argv[1][0] == '-') fatal("usage: score-query <log> [-u player_id] [-g game_id]");
+    std::string path = argv[1];
+
+    std::string player_id;
+    bool got_u = false, got_g = false;
+    uint64_t game_id = 0;
+    optind = 2;
+    int ch;
+    while ((ch = getopt(argc, argv, "u:g:")) != -1) {
+        switch (ch) {
+        case 'u':
+            player_id = optarg;
+            got_u = true;
+            break;
+        case 'g':
+            game_id = std::stoull(optarg);
+            got_g = true;
+            break;
+        default:
+            fatal("usage: score-query <log> [-u player_id] [-g game_id]");
+        }
+    }
+    if (got_u && got_g) fatal("options -u and -g are mutually exclusive");
+
+    score_log::Mapped_File log(path);
+    if (got_g) {
+        if (!show_game(log, path + ".idx", game_id)) {
+            std::cout << "no game " << game_id << "\n";
+            return 1;
+        }
+    } else if (got_u) {
+        player_history(log, player_id);
+    } else {
+        list_games(log);
+    }
+    return 0;
+}
@@ -0,0 +1,431 @@
+#pragma once   // Ensure this header is included at most once in each translation unit.
+
+/* --------------------------------------------------------------------------
+ * Standard-library and POSIX headers required for the writer thread, file
+ * I/O and the mmap-based reader.
+ * --------------------------------------------------------------------------*/
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "fixed.hpp"
+
+/* --------------------------------------------------------------------------
+ * The score_log namespace persists finished games.  Every game is one record
+ * appended to <path>; <path>.idx holds one fixed-size entry per record so a
+ * game can be located without scanning.
+ *
+ * Record layout (host byte order):
+ *   Record_Header { magic, payload length, CRC-32 of payload }
+ *   payload: game id (u64), end time in ms since the epoch (i64),
+ *            player count (u32), then per player in ranking order:
+ *            id length (u8), id bytes, score length (u8), score bytes.
+ * Scores are stored as the exact text sent in SCORING.
+ * --------------------------------------------------------------------------*/
+namespace score_log {
+
+    constexpr uint32_t MAGIC = 0x53585041;   // "APXS"
+
+    struct Record_Header {
+        uint32_t magic;
+        uint32_t length;    // Payload bytes following the header.
+        uint32_t crc;       // CRC-32 of the payload.
+    };
+
+    struct Index_Entry {
+        uint64_t offset;    // Position of the Record_Header in the log.
+        uint64_t game_id;
+        int64_t  end_ms;
+    };
+
+    /* Result is one player's final score, before it is ranked. */
+    struct Result {
+        std::string  player;
+        fixed::Score score;
+    };
+
+    /* rank orders results best first: lowest score, ties broken by player
+     * id, so the logged order is the game's ranking. */
+    inline void rank(std::vector<Result>& results) {
+        std::sort(results.begin(), results.end(), [](const Result& a, const Result& b) {
+            if (a.score < b.score) return true;
+            if (b.score < a.score) return false;
+            return a.player < b.player;
+        });
+    }
+
+    /* Game is one finished game, its players ranked by rank(). */
+    struct Game {
+        uint64_t                 id     = 0;
+        int64_t                  end_ms = 0;
+        std::vector<std::string> players;   // Best first.
+        std::vector<std::string> scores;    // Parallel to players.
+    };
+
+    /* ----------------------------------------------------------------------
+     * crc32 is the standard reflected CRC-32 (polynomial 0xEDB88320), driven
+     * by a table computed at compile time.
+     * -------------------------------------------------------------------- */
+    constexpr std::array<uint32_t, 256> make_crc_table() {
+        std::array<uint32_t, 256> table{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+        return table;
+    }
+
+    inline constexpr std::array<uint32_t, 256> CRC_TABLE = make_crc_table();
+
+    inline uint32_t crc32(const char* data, size_t size) {
+        uint32_t c = 0xFFFFFFFFu;
+        for (size_t i = 0; i < size; ++i) {
+            c = CRC_TABLE[(c ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (c >> 8);
+        }
+        return c ^ 0xFFFFFFFFu;
+    }
+
+    /* ---- Encoding ---------------------------------------------------------- */
+
+    template <typename T>
+    void put(std::string& out, T value) {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    // put_text appends a length-prefixed string; the protocol keeps ids and
+    // scores far below 255 bytes, anything longer is truncated.
+    inline void put_text(std::string& out, const std::string& text) {
+        uint8_t len = static_cast<uint8_t>(std::min<size_t>(text.size(), 255));
+        put(out, len);
+        out.append(text.data(), len);
+    }
+
+    // encode builds the complete record, header included.
+    inline std::string encode(const Game& game) {
+        std::string payload;
+        put(payload, game.id);
+        put(payload, game.end_ms);
+        put(payload, static_cast<uint32_t>(game.players.size()));
+        for (size_t i = 0; i < game.players.size(); ++i) {
+            put_text(payload, game.players[i]);
+            put_text(payload, i < game.scores.size() ? game.scores[i] : std::string());
+        }
+        Record_Header header{ MAGIC, static_cast<uint32_t>(payload.size()),
+                              crc32(payload.data(), payload.size()) };
+        std::string record;
+        record.reserve(sizeof(header) + payload.size());
+        put(record, header);
+        record += payload;
+        return record;
+    }
+
+    /* ---- Decoding ---------------------------------------------------------- */
+
+    /* Cursor reads fields from a byte range and fails instead of overrunning. */
+    class Cursor {
+    private:
+        const char* pos;
+        const char* end;
+    public:
+        Cursor(const char* begin, size_t size) : pos(begin), end(begin + size) {}
+
+        template <typename T>
+        bool get(T& value) {
+            if (static_cast<size_t>(end - pos) < sizeof(T)) return false;
+            std::memcpy(&value, pos, sizeof(T));
+            pos += sizeof(T);
+            return true;
+        }
+
+        bool get_text(std::string_view& text) {
+            uint8_t len;
+            if (!get(len) || static_cast<size_t>(end - pos) < len) return false;
+            text = std::string_view(pos, len);
+            pos += len;
+            return true;
+        }
+
+        bool done() const {
+            return pos == end;
+        }
+    };
+
+    /* Entry is a decoded player line; views point into the mapped file. */
+    struct Entry {
+        std::string_view player;
+        std::string_view score;
+    };
+
+    struct Game_View {
+        uint64_t           offset;
+        uint64_t           id;
+        int64_t            end_ms;
+        std::vector<Entry> entries;   // Best first.
+    };
+
+    /* decode_at validates the record at offset and fills view.  It returns the
+     * offset of the next record, or 0 when the record is truncated, has a bad
+     * checksum or does not parse. */
+    inline size_t decode_at(const char* data, size_t size, size_t offset, Game_View& view) {
+        Record_Header header;
+        if (size - offset < sizeof(header)) return 0;
+        std::memcpy(&header, data + offset, sizeof(header));
+        size_t payload_at = offset + sizeof(header);
+        if (header.magic != MAGIC || size - payload_at < header.length) return 0;
+        const char* payload = data + payload_at;
+        if (crc32(payload, header.length) != header.crc) return 0;
+
+        Cursor cur(payload, header.length);
+        uint32_t count;
+        if (!cur.get(view.id) || !cur.get(view.end_ms) || !cur.get(count)) return 0;
+        view.offset = offset;
+        view.entries.clear();
+        for (uint32_t i = 0; i < count; ++i) {
+            Entry e;
+            if (!cur.get_text(e.player) || !cur.get_text(e.score)) return 0;
+            view.entries.push_back(e);
+        }
+        if (!cur.done()) return 0;
+        return payload_at + header.length;
+    }
+
+    /* ----------------------------------------------------------------------
+     * Mapped_File is a read-only mmap of a whole file.
+     * -------------------------------------------------------------------- */
+    class Mapped_File {
+    private:
+        const char* base = nullptr;
+        size_t      length = 0;
+    public:
+        explicit Mapped_File(const std::string& path) {
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) return;
+            struct stat st;
+            if (fstat(fd, &st) == 0 && st.st_size > 0) {
+                void* p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p != MAP_FAILED) {
+                    base = static_cast<const char*>(p);
+                    length = static_cast<size_t>(st.st_size);
+                    madvise(p, length, MADV_SEQUENTIAL);
+                }
+            }
+            close(fd);
+        }
+
+        Mapped_File(const Mapped_File&) = delete;
+        Mapped_File& operator=(const Mapped_File&) = delete;
+
+        ~Mapped_File() {
+            if (base) munmap(const_cast<char*>(base), length);
+        }
+
+        const char* data() const { return base; }
+        size_t      size() const { return length; }
+    };
+
+    /* scan calls fn for every valid record from the start of the log and
+     * returns the offset just past the last one; a torn tail ends the scan. */
+    inline size_t scan(const char* data, size_t size, const std::function<void(const Game_View&)>& fn) {
+        size_t offset = 0;
+        Game_View view;
+        while (offset < size) {
+            size_t next = decode_at(data, size, offset, view);
+            if (next == 0) break;
+            if (fn) fn(view);
+            offset = next;
+        }
+        return offset;
+    }
+
+    /* ----------------------------------------------------------------------
+     * Writer appends games from a background thread so that ending a game
+     * costs the reactor only a queue push.  On open it scans the existing log,
+     * cuts off a torn tail left by a crash, and rewrites the index from the
+     * records that survived, so log and index always agree.
+     * -------------------------------------------------------------------- */
+    class Writer {
+    private:
+        std::string path;
+        int log_fd = -1;
+        int idx_fd = -1;
+        uint64_t log_size = 0;
+        uint64_t idx_size = 0;
+        bool broken = false;            // A failed append could not be undone.
+        uint64_t next_id = 0;
+        uint64_t submitted_count = 0;   // Touched only by the submitting thread.
+
+        std::mutex mutex;
+        std::condition_variable ready;
+        std::deque<Game> pending;
+        bool stop = false;
+        uint64_t written_count = 0;     // Guarded by mutex.
+        uint64_t failed_count  = 0;     // Guarded by mutex.
+        std::thread worker;
+
+        // write_all retries short writes; returns false on an I/O error.
+        static bool write_all(int fd, const char* data, size_t size) {
+            while (size > 0) {
+                ssize_t n = ::write(fd, data, size);
+                if (n < 0) {
+                    if (errno == EINTR) continue;
+                    return false;
+                }
+                data += n;
+                size -= static_cast<size_t>(n);
+            }
+            return true;
+        }
+
+        // recover validates the existing log and rebuilds the index.
+        bool recover() {
+            std::string index;
+            uint64_t last_id = 0;
+            bool any = false;
+            size_t valid_end;
+            {
+                Mapped_File log(path);
+                valid_end = scan(log.data(), log.size(), [&](const Game_View& g) {
+                    put(index, Index_Entry{ g.offset, g.id, g.end_ms });
+                    last_id = g.id;
+                    any = true;
+                });
+                if (log.size() > valid_end) {
+                    std::cerr << "WARNING: score log " << path << " has "
+                              << log.size() - valid_end << " trailing bytes, truncating \r\n";
+                }
+            }
+            if (ftruncate(log_fd, static_cast<off_t>(valid_end)) < 0) return false;
+            if (ftruncate(idx_fd, 0) < 0) return false;
+            if (!write_all(idx_fd, index.data(), index.size())) return false;
+            log_size = valid_end;
+            idx_size = index.size();
+            next_id = any ? last_id + 1 : 0;
+            return true;
+        }
+
+        // append writes one record and its index entry.  A failure part way
+        // cuts both files back to where they were, so a partial record never
+        // shifts the offsets of the ones after it; if even that fails, the
+        // writer stops appending and counts the remaining games as failed.
+        void append(const Game& game) {
+            std::string record = encode(game);
+            Index_Entry entry{ log_size, game.id, game.end_ms };
+            bool ok = !broken
+                   && write_all(log_fd, record.data(), record.size())
+                   && fdatasync(log_fd) == 0
+                   && write_all(idx_fd, reinterpret_cast<const char*>(&entry), sizeof(entry));
+            if (ok) {
+                log_size += record.size();
+                idx_size += sizeof(entry);
+            } else if (!broken && (ftruncate(log_fd, static_cast<off_t>(log_size)) < 0
+                                || ftruncate(idx_fd, static_cast<off_t>(idx_size)) < 0)) {
+                broken = true;
+                std::cerr << "WARNING: score log " << path
+                          << " cannot be rolled back, no more games will be logged \r\n";
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            if (ok) ++written_count; else ++failed_count;
+        }
+
+        void run() {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                ready.wait(lock, [this] { return stop || !pending.empty(); });
+                if (pending.empty()) return;     // stop requested and drained
+                Game game = std::move(pending.front());
+                pending.pop_front();
+                lock.unlock();
+                append(game);
+                lock.lock();
+            }
+        }
+
+    public:
+        explicit Writer(const std::string& log_path) : path(log_path) {
+            log_fd = open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            idx_fd = open((path + ".idx").c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            if (log_fd < 0 || idx_fd < 0 || !recover()) {
+                if (log_fd >= 0) close(log_fd);
+                if (idx_fd >= 0) close(idx_fd);
+                log_fd = idx_fd = -1;
+                return;
+            }
+            worker = std::thread(&Writer::run, this);
+        }
+
+        Writer(const Writer&) = delete;
+        Writer& operator=(const Writer&) = delete;
+
+        // The destructor writes whatever is still queued before returning.
+        ~Writer() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stop = true;
+            }
+            ready.notify_one();
+            if (worker.joinable()) worker.join();
+            if (log_fd >= 0) close(log_fd);
+            if (idx_fd >= 0) close(idx_fd);
+        }
+
+        bool is_open() const {
+            return log_fd >= 0;
+        }
+
+        /* submit ranks the results, assigns the next game id and queues the
+         * game; it never waits for the disk.  Called only from the reactor
+         * thread. */
+        void submit(std::vector<Result> results) {
+            rank(results);
+            Game game;
+            game.id = next_id++;
+            ++submitted_count;
+            game.end_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+            for (const Result& r : results) {
+                game.players.push_back(r.player);
+                game.scores.push_back(fixed::to_string(r.score));
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                pending.push_back(std::move(game));
+            }
+            ready.notify_one();
+        }
+
+        uint64_t submitted() const {
+            return submitted_count;
+        }
+
+        uint64_t written() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return written_count;
+        }
+
+        uint64_t failed() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return failed_count;
+        }
+    };
+
+} // namespace score_log